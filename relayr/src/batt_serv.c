@@ -1,10 +1,8 @@
 #include "simble.h"
 #include <ble_srv_common.h>
 
-#define ADC_REF_VOLTAGE_IN_MILLIVOLTS   1200                                        /**< Reference voltage (in milli volts) used by ADC while doing conversion. */
-#define ADC_PRE_SCALING_COMPENSATION    3                                           /**< The ADC is configured to use VDD with 1/3 prescaling as input. And hence the result of conversion is to be multiplied by 3 to get the actual value of the battery voltage.*/
-#define ADC_RESULT_IN_MILLI_VOLTS(ADC_VALUE) \
-        ((((ADC_VALUE) * ADC_REF_VOLTAGE_IN_MILLIVOLTS) / 255) * ADC_PRE_SCALING_COMPENSATION) /** <Convert the result of ADC conversion in millivolts. */
+#include "batt_serv.h"
+#include "simble_energy.h"
 
 
 struct batt_serv_ctx {
@@ -29,7 +27,7 @@ static struct batt_serv_ctx batt_serv_ctx;
 // 	NRF_ADC->TASKS_STOP     = 1;
 //
 // 	batt_lvl_in_milli_volts = ADC_RESULT_IN_MILLI_VOLTS(batt_serv_ctx.last_reading);
-// 	batt_serv_ctx.last_reading = battery_level_in_percent(batt_lvl_in_milli_volts);
+// 	batt_serv_ctx.last_reading = batt_level_in_percent(batt_lvl_in_milli_volts);
 //
 // 	simble_srv_char_update(&batt_serv_ctx.batt_lvl, &batt_serv_ctx.last_reading);
 // }
@@ -60,6 +58,7 @@ adc_read_start()
 static uint16_t
 adc_read_blocking()
 {
+	simble_energy_begin(SIMBLE_ENERGY_ADC);
 	while (NRF_ADC->BUSY == 1) {
 		// __asm("nop");
 	}
@@ -77,8 +76,9 @@ adc_read_blocking()
 	uint16_t    batt_lvl_in_milli_volts;
 	uint16_t result = NRF_ADC->RESULT;
 	batt_lvl_in_milli_volts = ADC_RESULT_IN_MILLI_VOLTS(result);
-	result = battery_level_in_percent(batt_lvl_in_milli_volts);
+	result = batt_level_in_percent(batt_lvl_in_milli_volts);
 	NRF_ADC->TASKS_STOP     = 1;
+	simble_energy_end(SIMBLE_ENERGY_ADC);
 	return result;
 }
 
@@ -1,6 +1,34 @@
 #ifndef BATT_SERV_H
 #define BATT_SERV_H
 
+#include <stdint.h>
+
+#include "fixmath.h"
+
+/* Battery voltage and level, in the header for the host tests in
+   tools/trace-replay. */
+#define ADC_REF_VOLTAGE_IN_MILLIVOLTS   1200                                        /**< Reference voltage (in milli volts) used by ADC while doing conversion. */
+#define ADC_PRE_SCALING_COMPENSATION    3                                           /**< The ADC is configured to use VDD with 1/3 prescaling as input. And hence the result of conversion is to be multiplied by 3 to get the actual value of the battery voltage.*/
+/** <Convert the 8 bit result of ADC conversion in millivolts, as
+    ((ADC_VALUE * 1200) / 255) * 3 without the division: 1200/255 = 80/17. */
+#define ADC_RESULT_IN_MILLI_VOLTS(ADC_VALUE) \
+        (FIX_SCALE((ADC_VALUE), ADC_REF_VOLTAGE_IN_MILLIVOLTS / 15, 255 / 15, 20) * ADC_PRE_SCALING_COMPENSATION)
+
+/* Linearized discharge curve, same break points as battery_level_in_percent() */
+static const struct fix_pwl_seg batt_discharge_curve[] = {
+	FIX_PWL_SEG(2100, 0, 2440, 6),
+	FIX_PWL_SEG(2440, 6, 2740, 18),
+	FIX_PWL_SEG(2740, 18, 2900, 42),
+	FIX_PWL_SEG(2900, 42, 3000, 100),
+};
+
+static inline uint8_t
+batt_level_in_percent(uint16_t mvolts)
+{
+	return fix_pwl_eval(batt_discharge_curve,
+		sizeof(batt_discharge_curve) / sizeof(batt_discharge_curve[0]), mvolts);
+}
+
 void batt_serv_init(void);
 
 #endif
@@ -0,0 +1,157 @@
+#include <string.h>
+#include <nordic_common.h>
+
+#include "simble.h"
+#include "simble_evt.h"
+#include "bench_serv.h"
+#include "rtc.h"
+#include "gatt_codec.h"
+
+struct bench_serv_ctx {
+	struct service_desc;
+	struct char_desc ctrl;
+	struct char_desc data;
+	struct char_desc stats_char;
+	struct bench_ctrl cfg;
+	struct bench_stats stats;
+	uint32_t start;
+	uint32_t seq;
+	bool notify_enabled;
+	uint8_t payload[BENCH_MAX_PAYLOAD];
+};
+
+static struct bench_serv_ctx bench_serv_ctx;
+static struct simble_evt_handler bench_tx_handler;
+
+static void
+bench_account(struct bench_serv_ctx *ctx, uint16_t len)
+{
+	ctx->stats.packets++;
+	ctx->stats.bytes += len;
+	ctx->stats.ticks = rtc_now() - ctx->start;
+}
+
+/* fill the TX buffers, resumed on BLE_EVT_TX_COMPLETE */
+static void
+bench_flood(struct bench_serv_ctx *ctx)
+{
+	while (ctx->cfg.mode == BENCH_MODE_FLOOD) {
+		if (ctx->cfg.count != 0 && ctx->seq >= ctx->cfg.count) {
+			ctx->cfg.mode = BENCH_MODE_IDLE;
+			break;
+		}
+		gatt_put_le32(ctx->payload, ctx->seq);
+		uint32_t r = simble_srv_char_notify(&ctx->data, false, ctx->cfg.len, ctx->payload);
+		if (r == BLE_ERROR_NO_TX_BUFFERS)
+			break;
+		if (r != NRF_SUCCESS) {
+			ctx->stats.errors++;
+			ctx->cfg.mode = BENCH_MODE_IDLE;
+			break;
+		}
+		ctx->seq++;
+		bench_account(ctx, ctx->cfg.len);
+	}
+}
+
+static void
+bench_tx_complete_cb(ble_evt_t *evt, void *arg)
+{
+	if (evt->header.evt_id == BLE_EVT_TX_COMPLETE)
+		bench_flood(arg);
+}
+
+static void
+bench_ctrl_write_cb(struct service_desc *s, struct char_desc *c, const void *val, const uint16_t len)
+{
+	struct bench_serv_ctx *ctx = (struct bench_serv_ctx *)s;
+	const uint8_t *data = val;
+
+	if (len < sizeof(struct bench_ctrl))
+		return;
+	ctx->cfg.mode = data[0];
+	ctx->cfg.len = MIN(MAX(data[1], sizeof(uint32_t)), BENCH_MAX_PAYLOAD);
+	ctx->cfg.count = gatt_get_le16(&data[2]);
+	memset(&ctx->stats, 0, sizeof(ctx->stats));
+	memset(ctx->payload, 0, sizeof(ctx->payload));
+	ctx->seq = 0;
+	ctx->start = rtc_now();
+	if (ctx->cfg.mode == BENCH_MODE_FLOOD && ctx->notify_enabled)
+		bench_flood(ctx);
+}
+
+static void
+bench_data_write_cb(struct service_desc *s, struct char_desc *c, const void *val, const uint16_t len)
+{
+	struct bench_serv_ctx *ctx = (struct bench_serv_ctx *)s;
+
+	switch (ctx->cfg.mode) {
+	case BENCH_MODE_SINK:
+		bench_account(ctx, len);
+		break;
+	case BENCH_MODE_ECHO:
+		memcpy(ctx->payload, val, MIN(len, BENCH_MAX_PAYLOAD));
+		if (simble_srv_char_notify(&ctx->data, false, MIN(len, BENCH_MAX_PAYLOAD), ctx->payload) == NRF_SUCCESS)
+			bench_account(ctx, len);
+		else
+			ctx->stats.errors++;
+		break;
+	}
+}
+
+static void
+bench_data_notify_status_cb(struct service_desc *s, struct char_desc *c, const int8_t status)
+{
+	struct bench_serv_ctx *ctx = (struct bench_serv_ctx *)s;
+
+	ctx->notify_enabled = status & 1;
+	if (ctx->notify_enabled)
+		bench_flood(ctx);
+}
+
+static void
+bench_stats_read_cb(struct service_desc *s, struct char_desc *c, void **val, uint16_t *len)
+{
+	struct bench_serv_ctx *ctx = (struct bench_serv_ctx *)s;
+
+	*val = &ctx->stats;
+	*len = sizeof(ctx->stats);
+}
+
+static void
+bench_disconnect_cb(struct service_desc *s)
+{
+	struct bench_serv_ctx *ctx = (struct bench_serv_ctx *)s;
+
+	ctx->cfg.mode = BENCH_MODE_IDLE;
+	ctx->notify_enabled = false;
+}
+
+void
+bench_serv_init(void)
+{
+	struct bench_serv_ctx *ctx = &bench_serv_ctx;
+
+	simble_srv_init(ctx, simble_get_vendor_uuid_class(), VENDOR_UUID_BENCH_SERVICE);
+	simble_srv_char_add(ctx, &ctx->ctrl,
+		simble_get_vendor_uuid_class(), VENDOR_UUID_BENCH_CTRL_CHAR,
+		u8"Benchmark Control",
+		sizeof(struct bench_ctrl));
+	simble_srv_char_add(ctx, &ctx->data,
+		simble_get_vendor_uuid_class(), VENDOR_UUID_BENCH_DATA_CHAR,
+		u8"Benchmark Data",
+		BENCH_MAX_PAYLOAD);
+	simble_srv_char_add(ctx, &ctx->stats_char,
+		simble_get_vendor_uuid_class(), VENDOR_UUID_BENCH_STATS_CHAR,
+		u8"Benchmark Statistics",
+		sizeof(struct bench_stats));
+	ctx->ctrl.write_cb = bench_ctrl_write_cb;
+	ctx->data.write_cb = bench_data_write_cb;
+	ctx->data.notify = 1;
+	ctx->data.notify_status_cb = bench_data_notify_status_cb;
+	ctx->stats_char.read_cb = bench_stats_read_cb;
+	ctx->disconnect_cb = bench_disconnect_cb;
+	simble_srv_register(ctx);
+
+	simble_evt_register(&bench_tx_handler, SIMBLE_EVT_RANGE_COMMON, bench_tx_complete_cb, ctx);
+}
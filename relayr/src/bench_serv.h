@@ -0,0 +1,39 @@
+#ifndef BENCH_SERV_H
+#define BENCH_SERV_H
+
+#include <stdint.h>
+
+/* GATT throughput benchmark service.
+ *
+ * ctrl (write):  struct bench_ctrl, starts a run and resets the stats
+ * data (write without response, notify): the payload path
+ * stats (read):  struct bench_stats of the current/last run
+ *
+ * Notification payloads start with a little endian uint32 sequence
+ * number; echo mode returns written payloads unchanged. */
+
+enum bench_mode {
+	BENCH_MODE_IDLE = 0,
+	BENCH_MODE_FLOOD = 1,	/* notify count payloads (0: until stopped) */
+	BENCH_MODE_SINK = 2,	/* count written payloads */
+	BENCH_MODE_ECHO = 3,	/* notify every written payload back */
+};
+
+#define BENCH_MAX_PAYLOAD 20	/* GATT_MTU_SIZE_DEFAULT - 3 */
+
+struct bench_ctrl {
+	uint8_t mode;
+	uint8_t len;
+	uint16_t count;
+} __attribute__((packed));
+
+struct bench_stats {
+	uint32_t bytes;
+	uint32_t packets;
+	uint32_t errors;
+	uint32_t ticks;		/* RTC ticks from start to the last packet */
+} __attribute__((packed));
+
+void bench_serv_init(void);
+
+#endif
@@ -13,10 +13,20 @@ SRCS+= \
 	${RELAYR_ROOT}/src/indicator.c \
 	${RELAYR_ROOT}/src/onboard-led.c \
 	${RELAYR_ROOT}/src/simble.c \
+	${RELAYR_ROOT}/src/simble_evt.c \
+	${RELAYR_ROOT}/src/char_report.c \
 	${RELAYR_ROOT}/src/util.c \
+	${RELAYR_ROOT}/src/pool.c \
 	${RELAYR_ROOT}/src/batt_serv.c \
+	${RELAYR_ROOT}/src/bench_serv.c \
 	${RELAYR_ROOT}/src/rtc.c \
+	${RELAYR_ROOT}/src/sampling_period.c \
+	${RELAYR_ROOT}/src/sensor_serv.c \
+	${RELAYR_ROOT}/src/sensor_die_temp.c \
 	${RELAYR_ROOT}/src/segger_rtt_init.c \
+	${RELAYR_ROOT}/src/simble_trace.c \
+	${RELAYR_ROOT}/src/simble_energy.c \
+	${RELAYR_ROOT}/src/simble_boot.c \
 	${SDKDIR}/segger/RTT/SEGGER_RTT.c \
 	${SDKDIR}/segger/RTT/SEGGER_RTT_printf.c \
 	${SDKDIR}/segger/Syscalls/RTT_Syscalls_GCC.c
@@ -25,7 +35,9 @@ ifeq (${USE_SOFTDEVICE},s120)
 DEFINES+= SD120
 
 SRCS+= \
-	${RELAYR_ROOT}/src/simble_central.c
+	${RELAYR_ROOT}/src/simble_central.c \
+	${RELAYR_ROOT}/src/simble_central_aggr.c \
+	${RELAYR_ROOT}/src/simble_central_bench.c
 
 SDKSRCS+= \
 	ble/device_manager/device_manager_central.c \
@@ -35,4 +47,16 @@ SDKINCDIRS+= \
 	libraries/trace
 endif
 
+ifdef SIMBLE_TRACE
+DEFINES+= SIMBLE_TRACE
+endif
+
+ifdef SIMBLE_ENERGY
+DEFINES+= SIMBLE_ENERGY
+endif
+
+ifdef SIMBLE_FAST_START
+DEFINES+= SIMBLE_FAST_START
+endif
+
 DEFINES+= BLE_STACK_SUPPORT_REQD SOFTDEVICE_PRESENT __HEAP_SIZE=0
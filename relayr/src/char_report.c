@@ -0,0 +1,181 @@
+#include <string.h>
+
+#include <ble.h>
+
+#include "simble.h"
+#include "char_report.h"
+#include "rtc.h"
+
+enum report_kind {
+        REPORT_INT,
+        REPORT_FLOAT,
+        REPORT_OPAQUE,
+};
+
+static uint8_t
+report_decode(const struct char_desc *c, const uint8_t *p, uint16_t len, int64_t *iv, float *fv)
+{
+        uint8_t width = 0;
+        bool sign = false;
+
+        switch (c->format.format) {
+        case BLE_GATT_CPF_FORMAT_BOOLEAN:
+        case BLE_GATT_CPF_FORMAT_UINT8:
+                width = 1;
+                break;
+        case BLE_GATT_CPF_FORMAT_UINT12:
+        case BLE_GATT_CPF_FORMAT_UINT16:
+                width = 2;
+                break;
+        case BLE_GATT_CPF_FORMAT_UINT24:
+                width = 3;
+                break;
+        case BLE_GATT_CPF_FORMAT_UINT32:
+                width = 4;
+                break;
+        case BLE_GATT_CPF_FORMAT_SINT8:
+                width = 1;
+                sign = true;
+                break;
+        case BLE_GATT_CPF_FORMAT_SINT12:
+        case BLE_GATT_CPF_FORMAT_SINT16:
+                width = 2;
+                sign = true;
+                break;
+        case BLE_GATT_CPF_FORMAT_SINT24:
+                width = 3;
+                sign = true;
+                break;
+        case BLE_GATT_CPF_FORMAT_SINT32:
+                width = 4;
+                sign = true;
+                break;
+        case BLE_GATT_CPF_FORMAT_FLOAT32:
+                if (len < sizeof(*fv))
+                        return (REPORT_OPAQUE);
+                memcpy(fv, p, sizeof(*fv));
+                return (REPORT_FLOAT);
+        default:
+                return (REPORT_OPAQUE);
+        }
+
+        if (len < width)
+                return (REPORT_OPAQUE);
+
+        uint32_t u = 0;
+        for (int i = width - 1; i >= 0; i--)
+                u = (u << 8) | p[i];
+        if (sign && width < 4 && (u & (1u << (width * 8 - 1))))
+                u |= ~0u << (width * 8);
+        *iv = sign ? (int64_t)(int32_t)u : (int64_t)u;
+        return (REPORT_INT);
+}
+
+static uint32_t
+report_hash(const uint8_t *p, uint16_t len)
+{
+        /* FNV-1a */
+        uint32_t h = 2166136261u;
+
+        while (len--)
+                h = (h ^ *p++) * 16777619u;
+        return (h);
+}
+
+void
+char_report_reset(struct char_report *r)
+{
+        r->valid = false;
+        r->sent = 0;
+        r->suppressed = 0;
+}
+
+void
+char_report_force_next(struct char_report *r)
+{
+        r->valid = false;
+}
+
+bool
+char_report_due(struct char_desc *c, const void *val, uint16_t len)
+{
+        struct char_report *r = c->report;
+        uint32_t elapsed = rtc_now() - r->last_at;
+        int64_t iv;
+        float fv;
+
+        if (!r->valid)
+                return (true);
+        if (r->min_interval_ms != 0 && elapsed < RTC_MS_TO_TICKS(r->min_interval_ms))
+                goto suppress;
+        if (r->max_interval_ms != 0 && elapsed >= RTC_MS_TO_TICKS(r->max_interval_ms))
+                return (true);
+        if (!r->on_change && r->abs_deadband == 0 && r->rel_deadband == 0)
+                return (true);
+
+        switch (report_decode(c, val, len, &iv, &fv)) {
+        case REPORT_INT: {
+                int64_t delta = iv - r->last.i;
+                int64_t mag = r->last.i;
+
+                if (delta < 0)
+                        delta = -delta;
+                if (mag < 0)
+                        mag = -mag;
+                if (delta == 0)
+                        goto suppress;
+                if (delta <= r->abs_deadband)
+                        goto suppress;
+                if (r->rel_deadband != 0 && delta * 1000 <= mag * r->rel_deadband)
+                        goto suppress;
+                return (true);
+        }
+        case REPORT_FLOAT: {
+                float delta = fv - r->last.f;
+                float mag = r->last.f;
+
+                if (delta < 0)
+                        delta = -delta;
+                if (mag < 0)
+                        mag = -mag;
+                if (delta == 0)
+                        goto suppress;
+                if (delta <= r->abs_deadband)
+                        goto suppress;
+                if (r->rel_deadband != 0 && delta * 1000 <= mag * r->rel_deadband)
+                        goto suppress;
+                return (true);
+        }
+        default:
+                if (report_hash(val, len) == r->last.hash)
+                        goto suppress;
+                return (true);
+        }
+
+suppress:
+        r->suppressed++;
+        return (false);
+}
+
+void
+char_report_sent(struct char_desc *c, const void *val, uint16_t len)
+{
+        struct char_report *r = c->report;
+        int64_t iv;
+        float fv;
+
+        switch (report_decode(c, val, len, &iv, &fv)) {
+        case REPORT_INT:
+                r->last.i = iv;
+                break;
+        case REPORT_FLOAT:
+                r->last.f = fv;
+                break;
+        default:
+                r->last.hash = report_hash(val, len);
+                break;
+        }
+        r->last_at = rtc_now();
+        r->valid = true;
+        r->sent++;
+}
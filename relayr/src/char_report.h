@@ -0,0 +1,43 @@
+#ifndef CHAR_REPORT_H
+#define CHAR_REPORT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct char_desc;
+
+/* Per characteristic reporting policy, applied by simble_srv_char_notify.
+ *
+ * Numeric values are decoded according to the characteristic
+ * presentation format; deadbands are in raw units of that format
+ * (before the exponent) resp. in 1/1000 of the last reported value.
+ * Values of other formats are compared as a whole.  A policy without
+ * deadbands and on_change only rate limits. */
+struct char_report {
+        int32_t abs_deadband;
+        uint16_t rel_deadband;          /* permille */
+        uint8_t on_change;              /* suppress unchanged values */
+        uint32_t min_interval_ms;       /* 0: no limit */
+        uint32_t max_interval_ms;       /* report anyway after, 0: never */
+
+        /* statistics */
+        uint32_t sent;
+        uint32_t suppressed;
+
+        /* last reported value */
+        bool valid;
+        uint32_t last_at;
+        union {
+                int64_t i;
+                float f;
+                uint32_t hash;
+        } last;
+};
+
+void char_report_reset(struct char_report *r);
+/* send the next value regardless of the policy, keeps the statistics */
+void char_report_force_next(struct char_report *r);
+bool char_report_due(struct char_desc *c, const void *val, uint16_t len);
+void char_report_sent(struct char_desc *c, const void *val, uint16_t len);
+
+#endif
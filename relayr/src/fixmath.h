@@ -0,0 +1,125 @@
+#ifndef FIXMATH_H
+#define FIXMATH_H
+
+#include <stdint.h>
+
+/* Division free integer scaling for the Cortex-M0, which has no divide
+ * instruction; every `/` on a variable is a call into libgcc.
+ *
+ * Division by a constant d becomes a multiply and shift with the
+ * reciprocal FIX_RECIP(d, s) = ceil(2^s / d).  The result is the exact
+ * floor(x / d) as long as x < 2^(s - ceil(log2 d)), and x * FIX_RECIP
+ * must fit 32 bits.  The reciprocals fold at compile time. */
+
+#define FIX_RECIP(d, shift) \
+        ((uint32_t)((((uint64_t)1 << (shift)) + (d) - 1) / (d)))
+
+static inline uint32_t
+fix_mulshift(uint32_t x, uint32_t recip, uint8_t shift)
+{
+        return ((x * recip) >> shift);
+}
+
+/* floor(x * num / den) with a compile time den */
+#define FIX_SCALE(x, num, den, shift) \
+        fix_mulshift((uint32_t)(x) * (num), FIX_RECIP(den, shift), shift)
+
+
+/* Piecewise linear transfer functions.
+ *
+ * A segment covers x_lo < x <= x_hi and evaluates, like the formulas
+ * they replace, from its upper end, with the quotient truncated
+ * toward zero as C division does:
+ *
+ *      y = y_hi - (x_hi - x) * (y_hi - y_lo) / (x_hi - x_lo)
+ *
+ * The step from y_hi is truncated, so y rounds toward y_hi: up on
+ * rising segments, down on falling ones.  The step is exact for
+ * (x_hi - x) * |y_hi - y_lo| < 2^15 and x_hi - x_lo < 2^9.  Segments
+ * are sorted by ascending x; inputs outside the table clamp to its end
+ * points.  x is unsigned 16 bit, the whole range of ADC codes and
+ * millivolts. */
+
+#define FIX_PWL_SHIFT 24
+
+struct fix_pwl_seg {
+        uint16_t x_lo;
+        uint16_t x_hi;
+        int16_t y_lo;
+        int16_t y_hi;
+        uint32_t recip;
+};
+
+#define FIX_PWL_SEG(xl, yl, xh, yh) {                           \
+                .x_lo = (xl), .x_hi = (xh),                     \
+                .y_lo = (yl), .y_hi = (yh),                     \
+                .recip = FIX_RECIP((xh) - (xl), FIX_PWL_SHIFT), \
+        }
+
+static inline int16_t
+fix_pwl_eval(const struct fix_pwl_seg *tab, uint8_t count, uint16_t x)
+{
+        const struct fix_pwl_seg *seg = tab;
+
+        if (x <= tab[0].x_lo)
+                return (tab[0].y_lo);
+        for (; seg < tab + count; seg++) {
+                if (x > seg->x_hi)
+                        continue;
+
+                int16_t rise = seg->y_hi - seg->y_lo;
+                uint32_t dx = seg->x_hi - x;
+                uint32_t q;
+
+                if (rise >= 0) {
+                        q = fix_mulshift(dx * rise, seg->recip, FIX_PWL_SHIFT);
+                        return (seg->y_hi - q);
+                }
+                q = fix_mulshift(dx * -rise, seg->recip, FIX_PWL_SHIFT);
+                return (seg->y_hi + q);
+        }
+        return (tab[count - 1].y_hi);
+}
+
+
+/* Saturating helpers */
+
+static inline uint8_t
+fix_sat_u8(int32_t v)
+{
+        return (v < 0 ? 0 : v > UINT8_MAX ? UINT8_MAX : v);
+}
+
+static inline uint16_t
+fix_sat_u16(int32_t v)
+{
+        return (v < 0 ? 0 : v > UINT16_MAX ? UINT16_MAX : v);
+}
+
+static inline int16_t
+fix_sat_i16(int32_t v)
+{
+        return (v < INT16_MIN ? INT16_MIN : v > INT16_MAX ? INT16_MAX : v);
+}
+
+static inline uint16_t
+fix_add_sat_u16(uint16_t a, uint16_t b)
+{
+        uint32_t v = (uint32_t)a + b;
+
+        return (v > UINT16_MAX ? UINT16_MAX : v);
+}
+
+static inline uint16_t
+fix_sub_sat_u16(uint16_t a, uint16_t b)
+{
+        return (a > b ? a - b : 0);
+}
+
+static inline int16_t
+fix_add_sat_i16(int16_t a, int16_t b)
+{
+        return (fix_sat_i16((int32_t)a + b));
+}
+
+#endif
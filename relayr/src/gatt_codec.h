@@ -0,0 +1,280 @@
+#ifndef GATT_CODEC_H
+#define GATT_CODEC_H
+
+#include <stdint.h>
+#include <ble_gatts.h>
+
+#include "simble.h"
+
+/* Inline encoders/decoders for characteristic payloads.
+ *
+ * Encoders write to p and return the position after the field, so a
+ * payload is built by chaining them; decoders read from p. */
+
+
+/* Integers; payload lengths are sums of these field sizes */
+
+#define GATT_U8_LEN     1
+#define GATT_U16_LEN    2
+#define GATT_U24_LEN    3
+#define GATT_U32_LEN    4
+
+static inline uint8_t *
+gatt_put_u8(uint8_t *p, uint8_t v)
+{
+        p[0] = v;
+        return (p + GATT_U8_LEN);
+}
+
+static inline uint8_t *
+gatt_put_le16(uint8_t *p, uint16_t v)
+{
+        p[0] = v;
+        p[1] = v >> 8;
+        return (p + GATT_U16_LEN);
+}
+
+static inline uint8_t *
+gatt_put_le24(uint8_t *p, uint32_t v)
+{
+        p[0] = v;
+        p[1] = v >> 8;
+        p[2] = v >> 16;
+        return (p + GATT_U24_LEN);
+}
+
+static inline uint8_t *
+gatt_put_le32(uint8_t *p, uint32_t v)
+{
+        p[0] = v;
+        p[1] = v >> 8;
+        p[2] = v >> 16;
+        p[3] = v >> 24;
+        return (p + GATT_U32_LEN);
+}
+
+static inline uint8_t *
+gatt_put_be16(uint8_t *p, uint16_t v)
+{
+        p[0] = v >> 8;
+        p[1] = v;
+        return (p + GATT_U16_LEN);
+}
+
+static inline uint8_t *
+gatt_put_be32(uint8_t *p, uint32_t v)
+{
+        p[0] = v >> 24;
+        p[1] = v >> 16;
+        p[2] = v >> 8;
+        p[3] = v;
+        return (p + GATT_U32_LEN);
+}
+
+static inline uint16_t
+gatt_get_le16(const uint8_t *p)
+{
+        return (p[0] | p[1] << 8);
+}
+
+static inline uint32_t
+gatt_get_le24(const uint8_t *p)
+{
+        return (p[0] | p[1] << 8 | (uint32_t)p[2] << 16);
+}
+
+static inline int32_t
+gatt_get_sle24(const uint8_t *p)
+{
+        return ((int32_t)(gatt_get_le24(p) << 8) >> 8);
+}
+
+static inline uint32_t
+gatt_get_le32(const uint8_t *p)
+{
+        return (p[0] | p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+}
+
+static inline uint16_t
+gatt_get_be16(const uint8_t *p)
+{
+        return (p[0] << 8 | p[1]);
+}
+
+static inline uint32_t
+gatt_get_be32(const uint8_t *p)
+{
+        return ((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | p[2] << 8 | p[3]);
+}
+
+
+/* IEEE-11073 16 bit SFLOAT and 32 bit FLOAT, mantissa * 10^exponent.
+ * Both encoders keep every digit: a value too large to represent is
+ * +-INF, one too small for the SFLOAT exponent NRes. */
+
+#define GATT_SFLOAT_NAN         0x07ff
+#define GATT_SFLOAT_NRES        0x0800
+#define GATT_SFLOAT_PINF        0x07fe
+#define GATT_SFLOAT_NINF        0x0802
+#define GATT_SFLOAT_MANT_MAX    2045
+#define GATT_SFLOAT_MANT_MIN    (-2045)
+#define GATT_SFLOAT_EXP_MAX     7
+#define GATT_SFLOAT_EXP_MIN     (-8)
+
+#define GATT_FLOAT_NAN          0x007fffff
+#define GATT_FLOAT_NRES         0x00800000
+#define GATT_FLOAT_PINF         0x007ffffe
+#define GATT_FLOAT_NINF         0x00800002
+#define GATT_FLOAT_MANT_MAX     8388605
+#define GATT_FLOAT_MANT_MIN     (-8388605)
+
+static inline uint16_t
+gatt_sfloat(int16_t mantissa, int8_t exponent)
+{
+        if (mantissa == 0)
+                return (0);
+        if (mantissa > GATT_SFLOAT_MANT_MAX || mantissa < GATT_SFLOAT_MANT_MIN ||
+            exponent > GATT_SFLOAT_EXP_MAX)
+                return (mantissa < 0 ? GATT_SFLOAT_NINF : GATT_SFLOAT_PINF);
+        if (exponent < GATT_SFLOAT_EXP_MIN)
+                return (GATT_SFLOAT_NRES);
+        return ((uint16_t)(exponent & 0xf) << 12 | (mantissa & 0xfff));
+}
+
+static inline uint8_t *
+gatt_put_sfloat(uint8_t *p, int16_t mantissa, int8_t exponent)
+{
+        return (gatt_put_le16(p, gatt_sfloat(mantissa, exponent)));
+}
+
+/* returns 0 for the special values (NaN, NRes, +-INF) */
+static inline int
+gatt_get_sfloat(const uint8_t *p, int16_t *mantissa, int8_t *exponent)
+{
+        uint16_t v = gatt_get_le16(p);
+        int16_t m = (int16_t)(v << 4) >> 4;
+
+        if (m >= GATT_SFLOAT_PINF || m <= (int16_t)(GATT_SFLOAT_NINF | 0xf000))
+                return (0);
+        *mantissa = m;
+        *exponent = (int16_t)v >> 12;
+        return (1);
+}
+
+static inline uint32_t
+gatt_float(int32_t mantissa, int8_t exponent)
+{
+        if (mantissa > GATT_FLOAT_MANT_MAX)
+                return (GATT_FLOAT_PINF);
+        if (mantissa < GATT_FLOAT_MANT_MIN)
+                return (GATT_FLOAT_NINF);
+        return ((uint32_t)(uint8_t)exponent << 24 | (mantissa & 0xffffff));
+}
+
+static inline uint8_t *
+gatt_put_float(uint8_t *p, int32_t mantissa, int8_t exponent)
+{
+        return (gatt_put_le32(p, gatt_float(mantissa, exponent)));
+}
+
+static inline int
+gatt_get_float(const uint8_t *p, int32_t *mantissa, int8_t *exponent)
+{
+        uint32_t v = gatt_get_le32(p);
+        int32_t m = (int32_t)(v << 8) >> 8;
+
+        if (m >= GATT_FLOAT_PINF || m <= (int32_t)(GATT_FLOAT_NINF | 0xff000000))
+                return (0);
+        *mantissa = m;
+        *exponent = (int32_t)v >> 24;
+        return (1);
+}
+
+
+/* Vendor sensor characteristics, little endian on the air.  The
+ * lengths follow the gatt_put_* sequence of each encoder; the structs
+ * hold decoded values. */
+
+#define GATT_TEMP_LEN   GATT_U16_LEN            /* 0.01 degree Celsius */
+#define GATT_HUMID_LEN  GATT_U16_LEN            /* 0.01 %RH */
+#define GATT_COLOR_LEN  (4 * GATT_U16_LEN)      /* red, green, blue, clear */
+#define GATT_MOTION_LEN (6 * GATT_U16_LEN)      /* accel[3], gyro[3] */
+
+struct gatt_color {
+        uint16_t red;
+        uint16_t green;
+        uint16_t blue;
+        uint16_t clear;
+};
+
+struct gatt_motion {
+        int16_t accel[3];       /* mg */
+        int16_t gyro[3];        /* 0.01 degree/s */
+};
+
+/* presentation formats for simble_srv_char_attach_format() */
+#define GATT_TEMP_FORMAT        BLE_GATT_CPF_FORMAT_SINT16, -2, ORG_BLUETOOTH_UNIT_DEGREE_CELSIUS
+#define GATT_HUMID_FORMAT       BLE_GATT_CPF_FORMAT_UINT16, -2, ORG_BLUETOOTH_UNIT_PERCENTAGE
+
+static inline uint8_t *
+gatt_put_temp(uint8_t *p, int16_t centi_celsius)
+{
+        return (gatt_put_le16(p, centi_celsius));
+}
+
+static inline int16_t
+gatt_get_temp(const uint8_t *p)
+{
+        return (gatt_get_le16(p));
+}
+
+static inline uint8_t *
+gatt_put_humid(uint8_t *p, uint16_t centi_percent)
+{
+        return (gatt_put_le16(p, centi_percent));
+}
+
+static inline uint16_t
+gatt_get_humid(const uint8_t *p)
+{
+        return (gatt_get_le16(p));
+}
+
+static inline uint8_t *
+gatt_put_color(uint8_t *p, uint16_t red, uint16_t green, uint16_t blue, uint16_t clear)
+{
+        p = gatt_put_le16(p, red);
+        p = gatt_put_le16(p, green);
+        p = gatt_put_le16(p, blue);
+        return (gatt_put_le16(p, clear));
+}
+
+static inline void
+gatt_get_color(const uint8_t *p, struct gatt_color *c)
+{
+        c->red = gatt_get_le16(p);
+        c->green = gatt_get_le16(p + GATT_U16_LEN);
+        c->blue = gatt_get_le16(p + 2 * GATT_U16_LEN);
+        c->clear = gatt_get_le16(p + 3 * GATT_U16_LEN);
+}
+
+static inline uint8_t *
+gatt_put_motion(uint8_t *p, const int16_t accel[3], const int16_t gyro[3])
+{
+        for (int i = 0; i < 3; i++)
+                p = gatt_put_le16(p, accel[i]);
+        for (int i = 0; i < 3; i++)
+                p = gatt_put_le16(p, gyro[i]);
+        return (p);
+}
+
+static inline void
+gatt_get_motion(const uint8_t *p, struct gatt_motion *m)
+{
+        for (int i = 0; i < 3; i++)
+                m->accel[i] = gatt_get_le16(p + GATT_U16_LEN * i);
+        for (int i = 0; i < 3; i++)
+                m->gyro[i] = gatt_get_le16(p + GATT_U16_LEN * (3 + i));
+}
+
+#endif
@@ -14,16 +14,11 @@ static void
 ind_write_cb(struct service_desc *s, struct char_desc *c, const void *val, const uint16_t len)
 {
         const uint8_t *datap = val;
-        uint8_t data = *datap;
-
-        switch (data) {
-        case 0:
-                onboard_led(ONBOARD_LED_OFF);
-                break;
-        case 1:
-                onboard_led(ONBOARD_LED_ON);
-                break;
-        }
+
+        /* 0 off, 1 on, higher values enum onboard_led_pattern */
+        if (len < 1 || *datap >= ONBOARD_LED_PATTERN_MAX)
+                return;
+        onboard_led_pattern(*datap);
 }
 
 void
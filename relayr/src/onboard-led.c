@@ -1,23 +1,184 @@
+#include <stdbool.h>
 #include <nrf_soc.h>
 
 #include "onboard-led.h"
 
+#define LED_PIN                 29
+#define LED_GPIOTE_CH           0
+#define LED_PPI_CH_BASE         0
+#define LED_MAX_EDGES           4
+#define LED_PPI_CH_STEP         (LED_PPI_CH_BASE + LED_MAX_EDGES)
+
+/* TIMER2 at 16 MHz / 2^9 = 31250 Hz, 16 bit: periods up to 2.09 s */
+#define LED_TIMER_PRESCALER     9
+#define LED_MS(ms)              ((ms) * 125 / 4)
+
+#define LED_BREATHE_PERIOD      LED_MS(16)
+#define LED_BREATHE_STEPS       16      /* per half cycle */
+#define LED_BREATHE_REPEAT      4       /* PWM periods per step, counted by TIMER1 */
+
+/* the LED toggles at every edge, starting on; the last edge restarts */
+struct led_pattern_desc {
+        uint8_t edges;
+        uint16_t cc[LED_MAX_EDGES];
+};
+
+static const struct led_pattern_desc led_patterns[ONBOARD_LED_PATTERN_MAX] = {
+        [ONBOARD_LED_PATTERN_BLINK_SLOW] = { 2, { LED_MS(500), LED_MS(1000) } },
+        [ONBOARD_LED_PATTERN_BLINK_FAST] = { 2, { LED_MS(100), LED_MS(200) } },
+        [ONBOARD_LED_PATTERN_PULSE] = { 4, { LED_MS(60), LED_MS(180), LED_MS(240), LED_MS(2000) } },
+        [ONBOARD_LED_PATTERN_BREATHE] = { 2, { 2, LED_BREATHE_PERIOD } },
+        [ONBOARD_LED_PATTERN_FLASH] = { 2, { LED_MS(30), LED_MS(2000) } },
+};
+
+static bool led_configured;
+static bool led_running;
+static uint8_t breathe_step;
+
+static void
+led_pin_config(void)
+{
+        if (led_configured)
+                return;
+        NRF_GPIO->PIN_CNF[LED_PIN] = GPIO_PIN_CNF_DIR_Output | GPIO_PIN_CNF_INPUT_Disconnect;
+        led_configured = true;
+}
+
+static void
+led_pattern_stop(void)
+{
+        if (!led_running)
+                return;
+        NRF_TIMER2->TASKS_STOP = 1;
+        NRF_TIMER1->TASKS_STOP = 1;
+        NRF_TIMER1->INTENCLR = TIMER_INTENCLR_COMPARE0_Msk;
+        sd_nvic_DisableIRQ(TIMER1_IRQn);
+        sd_ppi_channel_enable_clr(((1 << (LED_MAX_EDGES + 1)) - 1) << LED_PPI_CH_BASE);
+        /* hand the pin back to NRF_GPIO->OUT */
+        NRF_GPIOTE->CONFIG[LED_GPIOTE_CH] = 0;
+        NRF_TIMER2->TASKS_SHUTDOWN = 1;
+        NRF_TIMER1->TASKS_SHUTDOWN = 1;
+        led_running = false;
+}
+
 void
 onboard_led(enum onboard_led set)
 {
-        const int led_pin = 29;
-
-        /* set to ouput */
-        NRF_GPIO->PIN_CNF[led_pin] = GPIO_PIN_CNF_DIR_Output | GPIO_PIN_CNF_INPUT_Disconnect;
+        led_pattern_stop();
+        led_pin_config();
         switch (set) {
         case ONBOARD_LED_ON:
-                NRF_GPIO->OUTSET = (1 << led_pin);
+                NRF_GPIO->OUTSET = (1 << LED_PIN);
                 break;
         case ONBOARD_LED_OFF:
-                NRF_GPIO->OUTCLR = (1 << led_pin);
+                NRF_GPIO->OUTCLR = (1 << LED_PIN);
                 break;
         case ONBOARD_LED_TOGGLE:
-                NRF_GPIO->OUT ^= (1 << led_pin);
+                NRF_GPIO->OUT ^= (1 << LED_PIN);
                 break;
         }
 }
+
+/* quadratic ramp up and down, looks linear to the eye */
+static uint16_t
+breathe_duty(uint8_t step)
+{
+        uint32_t i = step < LED_BREATHE_STEPS ? step : 2 * LED_BREATHE_STEPS - step;
+        uint32_t duty = LED_BREATHE_PERIOD * i * i / (LED_BREATHE_STEPS * LED_BREATHE_STEPS);
+
+        if (duty < 2)
+                duty = 2;
+        if (duty > LED_BREATHE_PERIOD - 2)
+                duty = LED_BREATHE_PERIOD - 2;
+        return (duty);
+}
+
+/* every LED_BREATHE_REPEAT PWM periods */
+void
+TIMER1_IRQHandler(void)
+{
+        NRF_TIMER1->EVENTS_COMPARE[0] = 0;
+
+        uint8_t next_step = (breathe_step + 1) % (2 * LED_BREATHE_STEPS);
+        uint16_t duty = breathe_duty(next_step);
+        uint16_t old = NRF_TIMER2->CC[0];
+
+        /* moving CC[0] across the counter would drop a toggle and
+           invert the output; if the interrupt came late, retry on the
+           next period */
+        NRF_TIMER2->TASKS_CAPTURE[2] = 1;
+        if (NRF_TIMER2->CC[2] + 1 >= (duty < old ? duty : old)) {
+                NRF_TIMER1->CC[0] = 1;
+                return;
+        }
+        NRF_TIMER2->CC[0] = duty;
+        NRF_TIMER1->CC[0] = LED_BREATHE_REPEAT;
+        breathe_step = next_step;
+}
+
+void
+onboard_led_pattern(enum onboard_led_pattern pattern)
+{
+        const struct led_pattern_desc *p;
+
+        switch (pattern) {
+        case ONBOARD_LED_PATTERN_OFF:
+                onboard_led(ONBOARD_LED_OFF);
+                return;
+        case ONBOARD_LED_PATTERN_ON:
+                onboard_led(ONBOARD_LED_ON);
+                return;
+        default:
+                if (pattern >= ONBOARD_LED_PATTERN_MAX)
+                        return;
+                break;
+        }
+
+        led_pattern_stop();
+        led_pin_config();
+
+        p = &led_patterns[pattern];
+
+        NRF_TIMER2->MODE = TIMER_MODE_MODE_Timer;
+        NRF_TIMER2->BITMODE = TIMER_BITMODE_BITMODE_16Bit;
+        NRF_TIMER2->PRESCALER = LED_TIMER_PRESCALER;
+        NRF_TIMER2->TASKS_CLEAR = 1;
+        NRF_TIMER2->SHORTS = 1 << (TIMER_SHORTS_COMPARE0_CLEAR_Pos + p->edges - 1);
+        for (int i = 0; i < p->edges; i++) {
+                NRF_TIMER2->EVENTS_COMPARE[i] = 0;
+                NRF_TIMER2->CC[i] = p->cc[i];
+                sd_ppi_channel_assign(LED_PPI_CH_BASE + i,
+                                      &NRF_TIMER2->EVENTS_COMPARE[i],
+                                      &NRF_GPIOTE->TASKS_OUT[LED_GPIOTE_CH]);
+        }
+
+        NRF_GPIOTE->CONFIG[LED_GPIOTE_CH] =
+                (GPIOTE_CONFIG_MODE_Task << GPIOTE_CONFIG_MODE_Pos) |
+                (LED_PIN << GPIOTE_CONFIG_PSEL_Pos) |
+                (GPIOTE_CONFIG_POLARITY_Toggle << GPIOTE_CONFIG_POLARITY_Pos) |
+                (GPIOTE_CONFIG_OUTINIT_High << GPIOTE_CONFIG_OUTINIT_Pos);
+        sd_ppi_channel_enable_set(((1 << p->edges) - 1) << LED_PPI_CH_BASE);
+
+        if (pattern == ONBOARD_LED_PATTERN_BREATHE) {
+                /* TIMER1 counts the PWM periods, interrupting once per step */
+                breathe_step = 0;
+                NRF_TIMER1->MODE = TIMER_MODE_MODE_Counter;
+                NRF_TIMER1->BITMODE = TIMER_BITMODE_BITMODE_16Bit;
+                NRF_TIMER1->TASKS_CLEAR = 1;
+                NRF_TIMER1->EVENTS_COMPARE[0] = 0;
+                NRF_TIMER1->CC[0] = LED_BREATHE_REPEAT;
+                NRF_TIMER1->SHORTS = TIMER_SHORTS_COMPARE0_CLEAR_Msk;
+                NRF_TIMER1->INTENSET = TIMER_INTENSET_COMPARE0_Msk;
+                sd_ppi_channel_assign(LED_PPI_CH_STEP,
+                                      &NRF_TIMER2->EVENTS_COMPARE[1],
+                                      &NRF_TIMER1->TASKS_COUNT);
+                sd_ppi_channel_enable_set(1 << LED_PPI_CH_STEP);
+                sd_nvic_ClearPendingIRQ(TIMER1_IRQn);
+                sd_nvic_SetPriority(TIMER1_IRQn, NRF_APP_PRIORITY_LOW);
+                sd_nvic_EnableIRQ(TIMER1_IRQn);
+                NRF_TIMER1->TASKS_START = 1;
+        }
+
+        NRF_TIMER2->TASKS_START = 1;
+        led_running = true;
+}
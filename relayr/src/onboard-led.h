@@ -7,6 +7,23 @@ enum onboard_led {
         ONBOARD_LED_TOGGLE = -1,
 };
 
+/* Patterns run from TIMER2 compare events through PPI to a GPIOTE
+ * toggle task; the CPU only sets them up.  Breathe is the exception:
+ * the nRF51 has no PWM ramp, so TIMER1 counts PWM periods through PPI
+ * and its interrupt steps the duty cycle every few periods.  TIMER2
+ * keeps the HF clock running while a pattern is active. */
+enum onboard_led_pattern {
+        ONBOARD_LED_PATTERN_OFF = 0,
+        ONBOARD_LED_PATTERN_ON = 1,
+        ONBOARD_LED_PATTERN_BLINK_SLOW = 2,     /* 1 Hz */
+        ONBOARD_LED_PATTERN_BLINK_FAST = 3,     /* 5 Hz */
+        ONBOARD_LED_PATTERN_PULSE = 4,          /* double flash every 2 s */
+        ONBOARD_LED_PATTERN_BREATHE = 5,
+        ONBOARD_LED_PATTERN_FLASH = 6,          /* 30 ms every 2 s */
+        ONBOARD_LED_PATTERN_MAX
+};
+
 void onboard_led(enum onboard_led set);
+void onboard_led_pattern(enum onboard_led_pattern pattern);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,41 @@
+#include <nrf_soc.h>
+
+#include "pool.h"
+
+void *
+pool_alloc(struct pool *p)
+{
+        struct pool_block *b;
+        uint8_t nested;
+
+        sd_nvic_critical_region_enter(&nested);
+        b = p->free;
+        if (b != NULL)
+                p->free = b->next;
+        else if (p->carved < p->count)
+                b = (struct pool_block *)(p->mem + p->carved++ * p->block_size);
+
+        if (b != NULL) {
+                if (++p->used > p->peak)
+                        p->peak = p->used;
+        } else {
+                p->failed++;
+        }
+        sd_nvic_critical_region_exit(nested);
+        return (b);
+}
+
+void
+pool_free(struct pool *p, void *block)
+{
+        struct pool_block *b = block;
+        uint8_t nested;
+
+        if (b == NULL)
+                return;
+        sd_nvic_critical_region_enter(&nested);
+        b->next = p->free;
+        p->free = b;
+        p->used--;
+        sd_nvic_critical_region_exit(nested);
+}
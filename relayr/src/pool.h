@@ -0,0 +1,60 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <app_util.h>
+#include <nordic_common.h>
+
+/* Fixed block pool.  The blocks are carved out of a static array sized
+ * at compile time.  Blocks are handed out from the untouched tail of
+ * the array first; released blocks go on a list threaded through the
+ * blocks themselves, so allocation and release are O(1) and need no
+ * initialization.  Both may be
+ * called from interrupt handlers. */
+
+struct pool_block {
+        struct pool_block *next;
+};
+
+struct pool {
+        struct pool_block *free;
+        uint8_t *mem;
+        uint16_t block_size;
+        uint16_t count;
+        uint16_t carved;        /* blocks taken from the array so far */
+        uint16_t used;
+        uint16_t peak;
+        uint32_t failed;        /* allocations refused */
+};
+
+#define POOL_BLOCK_SIZE(size) \
+        (CEIL_DIV(MAX((size), sizeof(struct pool_block)), sizeof(uint32_t)) * sizeof(uint32_t))
+
+/* defines `name`, a pool of nblocks blocks of at least size bytes;
+   the array is reserved whether or not the blocks are ever taken */
+#define POOL_DEFINE(name, size, nblocks)                                \
+        _Static_assert((nblocks) > 0, #name ": a pool needs blocks");  \
+        static uint32_t name##_mem[(nblocks) * POOL_BLOCK_SIZE(size) / sizeof(uint32_t)]; \
+        struct pool name = {                                            \
+                .mem = (uint8_t *)name##_mem,                           \
+                .block_size = POOL_BLOCK_SIZE(size),                    \
+                .count = (nblocks),                                     \
+        }
+
+void *pool_alloc(struct pool *p);
+void pool_free(struct pool *p, void *block);
+
+static inline uint16_t
+pool_used(const struct pool *p)
+{
+        return (p->used);
+}
+
+static inline uint16_t
+pool_peak(const struct pool *p)
+{
+        return (p->peak);
+}
+
+#endif
@@ -2,37 +2,107 @@
 
 #include "simble.h"
 #include "rtc.h"
+#include "simble_boot.h"
 
 
 // Configure the Tick interval, 0x20 = 32.768/32 = 1.024
 #define RTC_PRESCALER 31u
+// CC needs to be at least 2 ticks ahead of COUNTER to trigger
+#define RTC_MIN_AHEAD 2u
 
 
 static struct rtc_ctx *ctx;
+static volatile uint32_t rtc_overflows;
+// copy of INTENSET, the IRQ handler tests it without a peripheral read
+static volatile uint32_t rtc_inten;
+
+static void
+rtc_arm(uint8_t timer_id, uint32_t value)
+{
+  if (value < RTC_MIN_AHEAD)
+    value = RTC_MIN_AHEAD;
+  NRF_RTC1->EVENTS_COMPARE[timer_id] = 0;
+  NRF_RTC1->CC[timer_id] = (NRF_RTC1->COUNTER + value) & RTC_COUNTER_MASK;
+  ctx->rtc_x[timer_id].state = RTC_SLOT_ARMED;
+  cfg_int_mask(timer_id, true);
+}
 
 /* RTC : the default TICK_INTERVAL is 1ms, the module can manage up to 4 compare
       registers */
-void
+bool
 rtc_update_cfg(uint32_t value, uint8_t timer_id, bool enabled)
 {
-  ctx->rtc_x[timer_id].period = value;
+  struct rtc_x *x = &ctx->rtc_x[timer_id];
+  bool taken;
+
+  // a pending one-shot keeps the slot until it fires
+  sd_nvic_DisableIRQ(RTC1_IRQn);
+  taken = x->type == ONE_SHOT && x->state != RTC_SLOT_FREE;
+  if (!taken) {
+    // once masked the IRQ handler leaves the slot alone
+    cfg_int_mask(timer_id, false);
+    x->state = RTC_SLOT_CLAIMED;
+    x->type = PERIODIC;
+  }
+  sd_nvic_EnableIRQ(RTC1_IRQn);
+  if (taken)
+    return false;
+
+  x->period = value;
   //if period = 0 ->disable timer
-  ctx->rtc_x[timer_id].enabled = (enabled & (bool)value);
+  x->enabled = (enabled & (bool)value);
+
+  if (x->enabled)
+    rtc_arm(timer_id, value);
+  else if (value == 0)
+    x->state = RTC_SLOT_FREE;   // stopped; without cb, free for one-shots
+  else
+    x->state = RTC_SLOT_IDLE;
+  return true;
+}
+
+/* Change the period of a running timer keeping the phase of the current
+   interval: the next expiry becomes last expiry + value.  If that is
+   already past, the timer fires once right away instead of catching up. */
+void
+rtc_retime(uint32_t value, uint8_t timer_id)
+{
+  sd_nvic_DisableIRQ(RTC1_IRQn);
+
+  uint32_t old = ctx->rtc_x[timer_id].period;
+  ctx->rtc_x[timer_id].period = value;
 
-  if (enabled && (ctx->used_timers <= RTC_MAX_TIMERS)){
-    NRF_RTC1->EVENTS_COMPARE[timer_id] = 0;
-    NRF_RTC1->CC[timer_id] = NRF_RTC1->COUNTER + ctx->rtc_x[timer_id].period;
+  // an expiry not yet handled reloads CC with the new period in the ISR
+  if (ctx->rtc_x[timer_id].state == RTC_SLOT_ARMED &&
+      NRF_RTC1->EVENTS_COMPARE[timer_id] == 0) {
+    uint32_t counter = NRF_RTC1->COUNTER;
+    uint32_t next = (NRF_RTC1->CC[timer_id] - old + value) & RTC_COUNTER_MASK;
+    uint32_t ahead = (next - counter) & RTC_COUNTER_MASK;
+
+    if (ahead < RTC_MIN_AHEAD || ahead > (RTC_COUNTER_MASK >> 1))
+      next = (counter + RTC_MIN_AHEAD) & RTC_COUNTER_MASK;
+    NRF_RTC1->CC[timer_id] = next;
   }
-  cfg_int_mask(timer_id, ctx->rtc_x[timer_id].enabled);
+
+  sd_nvic_EnableIRQ(RTC1_IRQn);
 }
 
 void
 cfg_int_mask(uint8_t timer_id, bool enabled)
 {
-  if (enabled)
-    NRF_RTC1->INTENSET = RTC_INTENSET_COMPARE0_Msk << timer_id;
-  else
-    NRF_RTC1->INTENCLR = RTC_INTENCLR_COMPARE0_Msk << timer_id;
+  uint32_t bit = RTC_INTENSET_COMPARE0_Msk << timer_id;
+  uint8_t nested;
+
+  // the IRQ handler releases one-shots, keep the copy consistent
+  sd_nvic_critical_region_enter(&nested);
+  if (enabled) {
+    rtc_inten |= bit;
+    NRF_RTC1->INTENSET = bit;
+  } else {
+    NRF_RTC1->INTENCLR = bit;
+    rtc_inten &= ~bit;
+  }
+  sd_nvic_critical_region_exit(nested);
 }
 
 void
@@ -44,20 +114,33 @@ rtc_init(struct rtc_ctx *c)
   sd_nvic_SetPriority(RTC1_IRQn, NRF_APP_PRIORITY_LOW);
   sd_nvic_EnableIRQ(RTC1_IRQn);
 
+  // PRESCALER is only writable while stopped, simble_boot may run it
+  simble_boot_stop();
+  NRF_RTC1->TASKS_STOP = 1;
   //The LFCLK runs at 32.768 Hz, divided by (PRESCALER+1) = 1.024 ms
   NRF_RTC1->PRESCALER = RTC_PRESCALER;
   // Disable the Event routing to the PPI to save power
   NRF_RTC1->EVTEN = 0;
+  // Count COUNTER wraps to extend the time base used by rtc_now()
+  rtc_overflows = 0;
+  NRF_RTC1->EVENTS_OVRFLW = 0;
+  rtc_inten = RTC_INTENSET_OVRFLW_Msk;
+  NRF_RTC1->INTENSET = RTC_INTENSET_OVRFLW_Msk;
 
   for (int id=0; id < RTC_MAX_TIMERS; id++) {
-    if ((ctx->used_timers <= RTC_MAX_TIMERS) && (ctx->rtc_x[id].period != 0))
-    {
-      // Config. CC[x] module to generate interrupts and events
-      NRF_RTC1->CC[id] += ctx->rtc_x[id].period;
-      NRF_RTC1->EVTENSET = RTC_EVTENSET_COMPARE0_Msk << id;
-      cfg_int_mask(id, ctx->rtc_x[id].enabled);
-      ctx->used_timers++;
+    struct rtc_x *x = &ctx->rtc_x[id];
+
+    if (x->period == 0) {
+      cfg_int_mask(id, false);
+      x->type = PERIODIC;
+      x->state = RTC_SLOT_FREE;
+      continue;
     }
+    // Config. CC[x] module to generate interrupts, the counter starts at 0
+    NRF_RTC1->EVENTS_COMPARE[id] = 0;
+    NRF_RTC1->CC[id] = x->period;
+    x->state = x->enabled ? RTC_SLOT_ARMED : RTC_SLOT_IDLE;
+    cfg_int_mask(id, x->enabled);
   }
   // Reset the Counter
   NRF_RTC1->TASKS_CLEAR = 1;
@@ -68,47 +151,89 @@ rtc_init(struct rtc_ctx *c)
 bool
 rtc_oneshot_timer(uint32_t value, rtc_evt_cb_t *cb)
 {
-  int timer_id;
-  //Setup cb and assign a timer_id if free, return false is all used
-  if (ctx->used_timers <= RTC_MAX_TIMERS && (value !=0)){
-    timer_id = ctx->used_timers;
-
-    ctx->used_timers++;
-    ctx->rtc_x[timer_id].type = ONE_SHOT;
-    ctx->rtc_x[timer_id].cb = cb;
-    //ctx->rtc_x[timer_id].enabled = true;
-
-    rtc_update_cfg(value, timer_id, true);
-    return true;
+  int timer_id = -1;
+
+  // before rtc_init() there are no slots
+  if (value == 0 || ctx == NULL)
+    return false;
+
+  // claim a free slot no periodic owner holds; the handler may release
+  // one-shot slots meanwhile
+  sd_nvic_DisableIRQ(RTC1_IRQn);
+  for (int id = 0; id < RTC_MAX_TIMERS; id++) {
+    if (ctx->rtc_x[id].state == RTC_SLOT_FREE && ctx->rtc_x[id].cb == NULL) {
+      ctx->rtc_x[id].state = RTC_SLOT_CLAIMED;
+      ctx->rtc_x[id].type = ONE_SHOT;
+      timer_id = id;
+      break;
+    }
   }
-  else return false;
+  sd_nvic_EnableIRQ(RTC1_IRQn);
+  //return false if all are used
+  if (timer_id < 0)
+    return false;
+
+  struct rtc_x *x = &ctx->rtc_x[timer_id];
+  x->oneshot_cb = cb;
+  x->period = value;
+  x->enabled = true;
+  rtc_arm(timer_id, value);
+  return true;
+}
+
+uint32_t
+rtc_now(void)
+{
+  uint32_t hi, lo, pending;
+
+  do {
+    hi = rtc_overflows;
+    lo = NRF_RTC1->COUNTER;
+    pending = NRF_RTC1->EVENTS_OVRFLW;
+  } while (hi != rtc_overflows);
+
+  // overflow not yet accounted by the IRQ handler (masked or same priority)
+  if (pending && lo < (RTC_COUNTER_MASK >> 1))
+    hi++;
+
+  return (hi << 24) | lo;
 }
 
 /* The RTC1 instance IRQ handler*/
 void
 RTC1_IRQHandler(void)
 {
-  //NRF_GPIO->OUT ^= (1 << 1);
-  for (uint8_t id = 0; id < ctx->used_timers; id++){
-    if (NRF_RTC1->EVENTS_COMPARE[id] != 0)
-    {
-        // prepare the comparator for the next interval
-        NRF_RTC1->CC[id] += ctx->rtc_x[id].period;
-
-        // clear the event CC_x
-        NRF_RTC1->EVENTS_COMPARE[id] = 0;
-
-        //Toggle pin2 for test
-        NRF_GPIO->OUT ^= (1 << 2);
-
-        if (ctx->rtc_x[id].type == ONE_SHOT){
-          //release the timer
-          ctx->rtc_x[id].enabled = false;
-          ctx->used_timers--;
-          cfg_int_mask(id, false);
-        }
-        //call the registered callback
-        ctx->rtc_x[id].cb(ctx);
+  if (NRF_RTC1->EVENTS_OVRFLW != 0) {
+    NRF_RTC1->EVENTS_OVRFLW = 0;
+    rtc_overflows++;
+  }
+
+  for (uint8_t id = 0; id < RTC_MAX_TIMERS; id++){
+    struct rtc_x *x = &ctx->rtc_x[id];
+
+    // masked channels belong to their owner, leave their events alone
+    if ((rtc_inten & (RTC_INTENSET_COMPARE0_Msk << id)) == 0 ||
+        NRF_RTC1->EVENTS_COMPARE[id] == 0)
+      continue;
+
+    // clear the event CC_x
+    NRF_RTC1->EVENTS_COMPARE[id] = 0;
+    if (x->state != RTC_SLOT_ARMED)
+      continue;
+
+    rtc_evt_cb_t *cb = x->cb;
+    if (x->type == ONE_SHOT){
+      cb = x->oneshot_cb;
+      //release the timer, the callback may claim it again
+      cfg_int_mask(id, false);
+      x->enabled = false;
+      x->state = RTC_SLOT_FREE;
+    } else {
+      // prepare the comparator for the next interval
+      NRF_RTC1->CC[id] = (NRF_RTC1->CC[id] + x->period) & RTC_COUNTER_MASK;
     }
+    //call the registered callback
+    if (cb)
+      cb(ctx);
   }
 }
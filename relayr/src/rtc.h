@@ -9,30 +9,64 @@
 
 #define RTC_MAX_TIMERS  4
 
+/**< Tick rate of the RTC1 instance (PRESCALER 31 -> 1024 Hz, ~1ms). */
+#define RTC_TICK_FREQ 1024
+#define RTC_MS_TO_TICKS(ms) ((uint32_t)(((uint64_t)(ms) * RTC_TICK_FREQ) / 1000))
+#define RTC_TICKS_TO_MS(t) ((uint32_t)(((uint64_t)(t) * 1000) / RTC_TICK_FREQ))
+// COUNTER and CC are 24 bit, timer periods cannot be longer
+#define RTC_COUNTER_MASK 0xffffffu
+
 enum timer_type{
     PERIODIC = 0,
     ONE_SHOT = 1,
 };
 
+/* Slot ownership: a FREE slot is claimed by rtc_oneshot_timer() (with
+   the RTC1 IRQ masked for the scan only) or by the application for a
+   periodic timer.  The owner configures the slot and publishes it as
+   ARMED before unmasking its compare interrupt; from then on only the
+   IRQ handler touches the comparator, and it releases fired one-shot
+   slots.  The handler ignores slots that are not ARMED.
+
+   A slot with a cb belongs to its periodic owner for good: one-shots
+   only use slots without one, so rtc_update_cfg() and rtc_retime() on
+   an owned slot never find a one-shot in it.  rtc_update_cfg() with a
+   period of 0 stops the timer, with enabled false it pauses it.  It
+   only returns false for a slot without cb that a one-shot is using.
+   One-shots keep their callback in oneshot_cb. */
+enum rtc_slot_state {
+    RTC_SLOT_FREE = 0,
+    RTC_SLOT_CLAIMED,   // being configured
+    RTC_SLOT_IDLE,      // owned, not running
+    RTC_SLOT_ARMED,
+};
+
 struct rtc_ctx;
 
 typedef void (rtc_evt_cb_t)(struct rtc_ctx *ctx);
 
 struct rtc_x {
   uint8_t type;
+  volatile uint8_t state;
   uint32_t period;  //24 bits, max value: 16777216 (~4 hours @ 1ms tick)
   bool enabled;
   rtc_evt_cb_t *cb;
+  rtc_evt_cb_t *oneshot_cb;
 };
 
 struct rtc_ctx {
-	uint8_t used_timers;  //Max 4
   struct rtc_x rtc_x[RTC_MAX_TIMERS];
 };
 
-void rtc_update_cfg(uint32_t value, uint8_t timer_id, bool enabled);
+bool rtc_update_cfg(uint32_t value, uint8_t timer_id, bool enabled);
+void rtc_retime(uint32_t value, uint8_t timer_id);
 void rtc_init(struct rtc_ctx *ctx);
 void cfg_int_mask(uint8_t timer_id, bool enabled);
 bool rtc_oneshot_timer(uint32_t value, rtc_evt_cb_t *cb);
 
+/* 32 bit tick count since rtc_init(), extended past the 24 bit COUNTER
+   with the overflow event.  Wraps after ~48 days, compare with
+   unsigned subtraction. */
+uint32_t rtc_now(void);
+
 #endif
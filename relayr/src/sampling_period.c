@@ -0,0 +1,101 @@
+#include <app_util.h>
+#include <nordic_common.h>
+
+#include "sampling_period.h"
+#include "rtc.h"
+
+static uint32_t
+sampling_period_clamp(struct sampling_period *sp, uint32_t period_ms)
+{
+        /* no more than one sample per connection event */
+        uint32_t conn_ms = ((uint32_t)simble_get_conn_interval() * UNIT_1_25_MS + 999) / 1000;
+        uint32_t min = MAX(MAX(sp->min_ms, conn_ms), 1);
+        uint32_t max = RTC_TICKS_TO_MS(RTC_COUNTER_MASK);
+
+        if (sp->max_ms != 0 && sp->max_ms < max)
+                max = sp->max_ms;
+        if (period_ms < min)
+                period_ms = min;
+        if (period_ms > max)
+                period_ms = max;
+        return (period_ms);
+}
+
+uint32_t
+sampling_period_set(struct sampling_period *sp, uint32_t period_ms)
+{
+        sp->requested_ms = period_ms;
+        period_ms = sampling_period_clamp(sp, period_ms);
+        if (period_ms != sp->period_ms) {
+                sp->period_ms = period_ms;
+                rtc_retime(RTC_MS_TO_TICKS(period_ms), sp->timer_id);
+        }
+        return (period_ms);
+}
+
+static void
+sampling_period_write_cb(struct service_desc *s, struct char_desc *c, const void *val, const uint16_t len)
+{
+        struct sampling_period *sp = c->data;
+        const uint8_t *data = val;
+        uint32_t period_ms;
+
+        if (len == sizeof(uint32_t))
+                period_ms = uint32_decode(data);
+        else if (len == sizeof(uint16_t))
+                period_ms = uint16_decode(data);
+        else
+                return;
+        if (period_ms == 0)
+                return;
+
+        uint32_t old = sp->period_ms;
+        if (sampling_period_set(sp, period_ms) != old && sp->changed_cb)
+                sp->changed_cb(c, sp->period_ms);
+}
+
+/* the connection interval moved the lower bound, apply the request again */
+static void
+sampling_period_evt_cb(ble_evt_t *evt, void *arg)
+{
+        struct sampling_period *sp = arg;
+
+        switch (evt->header.evt_id) {
+        case BLE_GAP_EVT_CONNECTED:
+        case BLE_GAP_EVT_DISCONNECTED:
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+                break;
+        default:
+                return;
+        }
+        uint32_t old = sp->period_ms;
+        if (sp->requested_ms != 0 &&
+            sampling_period_set(sp, sp->requested_ms) != old && sp->changed_cb)
+                sp->changed_cb(sp->c, sp->period_ms);
+}
+
+static void
+sampling_period_read_cb(struct service_desc *s, struct char_desc *c, void **val, uint16_t *len)
+{
+        struct sampling_period *sp = c->data;
+
+        *val = &sp->period_ms;
+        *len = sizeof(sp->period_ms);
+}
+
+void
+sampling_period_char_add(struct service_desc *s, struct char_desc *c, struct sampling_period *sp)
+{
+        simble_srv_char_add(s, c,
+                            simble_get_vendor_uuid_class(), VENDOR_UUID_SAMPLING_PERIOD_CHAR,
+                            u8"Sampling Period",
+                            sizeof(sp->period_ms));
+        simble_srv_char_attach_format(c, BLE_GATT_CPF_FORMAT_UINT32,
+                                      -3, ORG_BLUETOOTH_UNIT_SECOND);
+        c->data = sp;
+        c->write_cb = sampling_period_write_cb;
+        c->read_cb = sampling_period_read_cb;
+        sp->c = c;
+        sp->requested_ms = sp->period_ms;
+        simble_evt_register(&sp->evt, SIMBLE_EVT_RANGE_GAP, sampling_period_evt_cb, sp);
+}
@@ -0,0 +1,28 @@
+#ifndef SAMPLING_PERIOD_H
+#define SAMPLING_PERIOD_H
+
+#include "simble.h"
+#include "simble_evt.h"
+
+typedef void (sampling_period_changed_cb_t)(struct char_desc *c, uint32_t period_ms);
+
+/* Sampling period control of a sensor service, bound to an RTC timer.
+   Writes are clamped to [min_ms, max_ms], to the 24 bit RTC range and
+   to what the current connection interval can carry, and the clamp is
+   redone when the interval changes; reads return the applied period.
+   A write of 0 is refused, the timer cannot be stopped over the air. */
+struct sampling_period {
+        uint8_t timer_id;
+        uint32_t min_ms;
+        uint32_t max_ms;
+        uint32_t period_ms;
+        sampling_period_changed_cb_t *changed_cb;
+        uint32_t requested_ms;
+        struct char_desc *c;
+        struct simble_evt_handler evt;
+};
+
+void sampling_period_char_add(struct service_desc *s, struct char_desc *c, struct sampling_period *sp);
+uint32_t sampling_period_set(struct sampling_period *sp, uint32_t period_ms);
+
+#endif
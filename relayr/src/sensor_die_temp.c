@@ -0,0 +1,29 @@
+#include <nrf_soc.h>
+
+#include "sensor_serv.h"
+#include "gatt_codec.h"
+
+/* nRF51 die temperature through the SoftDevice, 0.25 degree steps.
+   sd_temp_get() blocks for the ~36 us conversion, so there is no
+   separate start step. */
+
+static uint8_t
+die_temp_read(uint8_t *buf)
+{
+	int32_t temp;
+
+	if (sd_temp_get(&temp) != NRF_SUCCESS)
+		return (0);
+	return (gatt_put_temp(buf, temp * 25) - buf);
+}
+
+const struct sensor_driver sensor_die_temp = {
+	.name = u8"Die Temperature",
+	.uuid = VENDOR_UUID_TEMP_CHAR,
+	.len = GATT_TEMP_LEN,
+	.format = BLE_GATT_CPF_FORMAT_SINT16,
+	.exponent = -2,
+	.unit = ORG_BLUETOOTH_UNIT_DEGREE_CELSIUS,
+	.conv_ms = 0,
+	.read = die_temp_read,
+};
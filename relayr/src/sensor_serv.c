@@ -0,0 +1,226 @@
+#include <string.h>
+#include <nordic_common.h>
+#include <nrf_soc.h>
+
+#include "sensor_serv.h"
+#include "simble_evt.h"
+#include "simble_energy.h"
+#include "char_report.h"
+#include "pool.h"
+
+enum sensor_serv_state {
+	SENSOR_SERV_IDLE = 0,
+	SENSOR_SERV_CONVERTING,
+};
+
+struct sensor_serv_ctx {
+	struct service_desc;
+	struct char_desc char_slots[SENSOR_SERV_MAX_SENSORS + 1];
+	struct sensor *sensors;
+	uint8_t count;
+	uint8_t state;
+	volatile uint8_t ticks;		/* sampling periods not yet handled */
+	volatile bool timer_armed;
+	uint32_t ready_at;
+	uint32_t overruns;
+};
+
+static struct sensor_serv_ctx sensor_serv_ctx;
+static struct simble_idle_handler sensor_idle;
+
+void
+sensor_serv_timer_cb(struct rtc_ctx *rtc)
+{
+	/* interrupt context, the work is done from the event loop */
+	sensor_serv_ctx.ticks++;
+}
+
+static void
+sensor_conv_done_cb(struct rtc_ctx *rtc)
+{
+	sensor_serv_ctx.timer_armed = false;
+}
+
+static void
+sensor_arm_conv_timer(struct sensor_serv_ctx *ctx, uint32_t ticks)
+{
+	/* without a free timer the conversion is polled on the next event */
+	if (!ctx->timer_armed && rtc_oneshot_timer(ticks ? ticks : 1, sensor_conv_done_cb))
+		ctx->timer_armed = true;
+}
+
+/* start every sensor due in this period in one go */
+static void
+sensor_start_due(struct sensor_serv_ctx *ctx)
+{
+	uint16_t conv_ms = 0;
+	bool any = false;
+
+	for (int i = 0; i < ctx->count; i++) {
+		struct sensor *s = &ctx->sensors[i];
+
+		if (!s->present || --s->countdown != 0)
+			continue;
+		s->countdown = s->rate_div;
+		if (s->drv->start)
+			s->drv->start();
+		s->converting = true;
+		conv_ms = MAX(conv_ms, s->drv->conv_ms);
+		any = true;
+	}
+	if (!any)
+		return;
+	simble_energy_begin(SIMBLE_ENERGY_SENSOR);
+	ctx->state = SENSOR_SERV_CONVERTING;
+	ctx->ready_at = rtc_now() + RTC_MS_TO_TICKS(conv_ms);
+	if (conv_ms != 0)
+		sensor_arm_conv_timer(ctx, RTC_MS_TO_TICKS(conv_ms));
+}
+
+static void
+sensor_read_done(struct sensor_serv_ctx *ctx)
+{
+	for (int i = 0; i < ctx->count; i++) {
+		struct sensor *s = &ctx->sensors[i];
+
+		if (!s->converting)
+			continue;
+		s->converting = false;
+		uint8_t len = s->drv->read(s->buf);
+		if (s->drv->power_down)
+			s->drv->power_down();
+		if (len == 0) {
+			/* the characteristic keeps its last value */
+			s->read_errors++;
+			continue;
+		}
+		s->len = len;
+		s->samples++;
+		switch (simble_srv_char_notify_queued(s->c, s->len, s->buf)) {
+		case NRF_SUCCESS:
+		/* not connected or not subscribed */
+		case NRF_ERROR_INVALID_STATE:
+		case BLE_ERROR_INVALID_CONN_HANDLE:
+		case BLE_ERROR_GATTS_SYS_ATTR_MISSING:
+			break;
+		default:
+			s->dropped++;
+			break;
+		}
+	}
+	simble_energy_end(SIMBLE_ENERGY_SENSOR);
+	ctx->state = SENSOR_SERV_IDLE;
+}
+
+static void
+sensor_idle_cb(void *arg)
+{
+	struct sensor_serv_ctx *ctx = arg;
+
+	if (ctx->state == SENSOR_SERV_CONVERTING) {
+		int32_t left = ctx->ready_at - rtc_now();
+
+		if (left > 0) {
+			/* woken early, e.g. by a stale conversion timer */
+			sensor_arm_conv_timer(ctx, left);
+			return;
+		}
+		sensor_read_done(ctx);
+	}
+	uint8_t ticks, nested;
+
+	/* the RTC handler increments ticks */
+	sd_nvic_critical_region_enter(&nested);
+	ticks = ctx->ticks;
+	ctx->ticks = 0;
+	sd_nvic_critical_region_exit(nested);
+	if (ticks == 0)
+		return;
+	if (ticks > 1)
+		ctx->overruns += ticks - 1;
+	sensor_start_due(ctx);
+	/* conversions without settling time are read right away */
+	if (ctx->state == SENSOR_SERV_CONVERTING && (int32_t)(ctx->ready_at - rtc_now()) <= 0)
+		sensor_read_done(ctx);
+}
+
+static void
+sensor_read_cb(struct service_desc *sd, struct char_desc *c, void **val, uint16_t *len)
+{
+	struct sensor *s = c->data;
+
+	*val = s->buf;
+	*len = s->len;
+}
+
+static void
+sensor_notify_status_cb(struct service_desc *sd, struct char_desc *c, const int8_t status)
+{
+	struct sensor *s = c->data;
+
+	/* the next report is sent regardless of the deadbands */
+	if (s->report != NULL)
+		char_report_force_next(s->report);
+}
+
+void
+sensor_serv_init(struct sensor *sensors, uint8_t count, struct sampling_period *sp)
+{
+	struct sensor_serv_ctx *ctx = &sensor_serv_ctx;
+	struct char_desc *c = ctx->char_slots;
+
+	ctx->sensors = sensors;
+	ctx->count = MIN(count, SENSOR_SERV_MAX_SENSORS);
+	ctx->state = SENSOR_SERV_IDLE;
+	ctx->ticks = 0;
+	ctx->timer_armed = false;
+
+	simble_srv_init(ctx, simble_get_vendor_uuid_class(), VENDOR_UUID_SENSOR_SERVICE);
+	for (int i = 0; i < ctx->count; i++) {
+		struct sensor *s = &sensors[i];
+		const struct sensor_driver *drv = s->drv;
+
+		s->present = drv->init == NULL || drv->init();
+		if (!s->present)
+			continue;
+		s->buf = pool_alloc(&simble_payload_pool);
+		if (s->buf == NULL) {
+			if (drv->power_down)
+				drv->power_down();
+			s->present = false;
+			continue;
+		}
+		if (s->rate_div == 0)
+			s->rate_div = 1;
+		/* first sample on the first period */
+		s->countdown = 1;
+		s->converting = false;
+		s->len = 0;
+		memset(s->buf, 0, SENSOR_MAX_PAYLOAD);
+		s->c = c;
+
+		simble_srv_char_add(ctx, c,
+			simble_get_vendor_uuid_class(), drv->uuid,
+			drv->name,
+			MIN(drv->len, SENSOR_MAX_PAYLOAD));
+		if (drv->format != 0)
+			simble_srv_char_attach_format(c, drv->format, drv->exponent, drv->unit);
+		if (s->report != NULL)
+			simble_srv_char_attach_report(c, s->report);
+		c->data = s;
+		c->notify = 1;
+		c->read_cb = sensor_read_cb;
+		c->notify_status_cb = sensor_notify_status_cb;
+		c++;
+	}
+	sampling_period_char_add(ctx, c, sp);
+	simble_srv_register(ctx);
+
+	simble_idle_register(&sensor_idle, sensor_idle_cb, ctx);
+}
+
+uint32_t
+sensor_serv_overruns(void)
+{
+	return (sensor_serv_ctx.overruns);
+}
@@ -0,0 +1,63 @@
+#ifndef SENSOR_SERV_H
+#define SENSOR_SERV_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "simble.h"
+#include "sampling_period.h"
+#include "rtc.h"
+
+#define SENSOR_SERV_MAX_SENSORS 8
+#define SENSOR_MAX_PAYLOAD      SIMBLE_PAYLOAD_SIZE
+
+/* A sensor driver.  init() probes and configures the part and returns
+ * false if it is not fitted; start() begins a conversion, read() is
+ * called conv_ms later and encodes the result (gatt_codec.h) into buf,
+ * returning its length, or 0 leaving buf alone if the part failed;
+ * power_down() runs after every read.  start and power_down may be NULL. */
+struct sensor_driver {
+	const char *name;
+	uint16_t uuid;			/* VENDOR_UUID_*_CHAR */
+	uint8_t len;			/* characteristic length */
+	uint8_t format;			/* BLE_GATT_CPF_FORMAT_*, 0: none */
+	int8_t exponent;
+	uint16_t unit;
+	uint16_t conv_ms;
+	bool (*init)(void);
+	void (*start)(void);
+	uint8_t (*read)(uint8_t *buf);
+	void (*power_down)(void);
+};
+
+/* Registry entry, one per sensor the firmware may carry.  The sensors
+ * are sampled every rate_div sampling periods; all sensors due in a
+ * period are started together, and read together once the slowest
+ * conversion is done. */
+struct sensor {
+	const struct sensor_driver *drv;
+	uint8_t rate_div;		/* 0 is taken as 1 */
+	struct char_report *report;	/* optional */
+
+	/* runtime */
+	bool present;
+	bool converting;
+	uint8_t countdown;
+	uint8_t len;
+	struct char_desc *c;
+	uint32_t samples;
+	uint32_t dropped;		/* notifications neither sent nor queued */
+	uint32_t read_errors;		/* reads that returned no data */
+	uint8_t *buf;			/* simble_payload_pool, present sensors only, kept */
+};
+
+/* The sampling period timer (sp->timer_id) must be a periodic timer in
+ * the rtc_ctx with sensor_serv_timer_cb as callback. */
+void sensor_serv_init(struct sensor *sensors, uint8_t count, struct sampling_period *sp);
+void sensor_serv_timer_cb(struct rtc_ctx *ctx);
+uint32_t sensor_serv_overruns(void);
+
+/* drivers */
+extern const struct sensor_driver sensor_die_temp;
+
+#endif
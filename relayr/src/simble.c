@@ -4,6 +4,10 @@
 
 #include "simble.h"
 #include "onboard-led.h"
+#include "char_report.h"
+#include "simble_evt.h"
+#include "pool.h"
+#include "simble_boot.h"
 
 
 struct ble_gap_advdata {
@@ -28,9 +32,35 @@ struct ble_gap_ad_name {
 
 
 
+POOL_DEFINE(simble_payload_pool, SIMBLE_PAYLOAD_SIZE, SIMBLE_PAYLOAD_POOL_BLOCKS);
+#if SIMBLE_SRV_POOL_BLOCKS > 0
+POOL_DEFINE(simble_srv_pool,
+            sizeof(struct service_desc) + SIMBLE_SRV_POOL_CHARS * sizeof(struct char_desc),
+            SIMBLE_SRV_POOL_BLOCKS);
+#endif
+
 static struct service_desc *services;
+#ifdef SIMBLE_FAST_START
+static bool adv_early;
+#endif
+static struct simble_evt_handler app_handler;
 static uint16_t current_conn_handle = BLE_CONN_HANDLE_INVALID;
+static uint16_t current_conn_interval;
+
+/* notifications waiting for a TX buffer, oldest at notify_head; the
+   pool bounds the queue, so it needs no more entries than blocks */
+struct notify_entry {
+        struct char_desc *c;
+        uint8_t *buf;           /* simble_payload_pool */
+        uint16_t len;
+};
+static struct notify_entry notify_queue[SIMBLE_PAYLOAD_POOL_BLOCKS];
+static uint8_t notify_head;
+static uint8_t notify_count;
+
 
+static void srv_evt_register(void);
+static void simble_app_handle_ble_event(ble_evt_t *evt, void *arg);
 
 static uint32_t
 simble_add_advdata(const struct ble_gap_ad_header *data, struct ble_gap_advdata *advdata)
@@ -49,26 +79,64 @@ simble_add_advdata(const struct ble_gap_ad_header *data, struct ble_gap_advdata
         return NRF_SUCCESS;
 }
 
-void
-simble_adv_start(void)
+/* The name is read back from the SoftDevice on every start, so it
+   follows sd_ble_gap_device_name_set() after simble_init(). */
+static void
+simble_adv_prepare(struct ble_gap_advdata *advdata)
 {
-        struct ble_gap_advdata advdata = { .length = 0 };
-
+        advdata->length = 0;
         struct ble_gap_ad_flags flags = {
                 .payload_length = 1,
                 .type = BLE_GAP_AD_TYPE_FLAGS,
                 .flags = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE,
         };
-        simble_add_advdata(&flags, &advdata);
+        simble_add_advdata(&flags, advdata);
 
-        struct ble_gap_ad_name name;
-        uint16_t namelen = sizeof(advdata);
-        if (sd_ble_gap_device_name_get(name.name, &namelen) != NRF_SUCCESS)
+        struct ble_gap_ad_name adname;
+        uint16_t namelen = sizeof(adname.name);
+        /* whatever does not fit is dropped by simble_add_advdata */
+        if (sd_ble_gap_device_name_get(adname.name, &namelen) != NRF_SUCCESS)
                 namelen = 0;
-        name.type =  BLE_GAP_AD_TYPE_COMPLETE_LOCAL_NAME;
-        name.payload_length = namelen;
-        simble_add_advdata(&name, &advdata);
+        adname.type =  BLE_GAP_AD_TYPE_COMPLETE_LOCAL_NAME;
+        adname.payload_length = namelen;
+        simble_add_advdata(&adname, advdata);
+}
+
+#ifdef SIMBLE_FAST_START
+/* Visible before the GATT table exists, but not connectable: no
+   connection can see a partial table.  simble_adv_start() switches to
+   connectable advertising. */
+static void
+simble_adv_start_early(void)
+{
+        struct ble_gap_advdata advdata;
+
+        simble_adv_prepare(&advdata);
+        sd_ble_gap_adv_data_set(advdata.data, advdata.length, NULL, 0);
+
+        ble_gap_adv_params_t adv_params = {
+                .type = BLE_GAP_ADV_TYPE_ADV_NONCONN_IND,
+                .fp = BLE_GAP_ADV_FP_ANY,
+                .interval = BLE_GAP_ADV_NONCON_INTERVAL_MIN,
+        };
+        adv_early = sd_ble_gap_adv_start(&adv_params) == NRF_SUCCESS;
+        simble_boot_mark(SIMBLE_BOOT_ADV_EARLY);
+}
+#endif
+
+void
+simble_adv_start(void)
+{
+        struct ble_gap_advdata advdata;
 
+        simble_boot_mark(SIMBLE_BOOT_GATT_DONE);
+#ifdef SIMBLE_FAST_START
+        if (adv_early) {
+                sd_ble_gap_adv_stop();
+                adv_early = false;
+        }
+#endif
+        simble_adv_prepare(&advdata);
         sd_ble_gap_adv_data_set(advdata.data, advdata.length, NULL, 0);
 
         ble_gap_adv_params_t adv_params = {
@@ -77,7 +145,8 @@ simble_adv_start(void)
                 .interval = 0x400,
         };
         sd_ble_gap_adv_start(&adv_params);
-        onboard_led(ONBOARD_LED_ON);
+        simble_boot_mark(SIMBLE_BOOT_ADV_CONNECTABLE);
+        onboard_led_pattern(ONBOARD_LED_PATTERN_FLASH);
 }
 
 static void
@@ -116,6 +185,7 @@ void
 simble_init(const char *name)
 {
         sd_softdevice_enable(NRF_CLOCK_LFCLKSRC_XTAL_20_PPM, NULL); /* XXX assertion handler */
+        simble_boot_start();
 
         ble_enable_params_t ble_params = {
 #if defined(SD120)
@@ -128,11 +198,27 @@ simble_init(const char *name)
                 },
         };
         sd_ble_enable(&ble_params);
+        simble_boot_mark(SIMBLE_BOOT_BLE_ENABLED);
 
         ble_gap_conn_sec_mode_t mode;
         BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&mode);
         sd_ble_gap_device_name_set(&mode, (const uint8_t *)name, strlen(name));
+#ifdef SIMBLE_FAST_START
+        simble_adv_start_early();
+#endif
         simble_srv_tx_init();
+        simble_get_vendor_uuid_class();
+        simble_boot_mark(SIMBLE_BOOT_GATT_BASE);
+
+        srv_evt_register();
+        simble_evt_register(&app_handler, SIMBLE_EVT_RANGE_GAP, simble_app_handle_ble_event, NULL);
+}
+
+/* in 1.25ms units, 0 when not connected */
+uint16_t
+simble_get_conn_interval(void)
+{
+        return (current_conn_interval);
 }
 
 uint8_t
@@ -153,6 +239,7 @@ simble_srv_register(struct service_desc *s)
 {
         s->next = services;
         services = s;
+        srv_evt_register();
 
         sd_ble_gatts_service_add(BLE_GATTS_SRVC_TYPE_PRIMARY,
                                  &s->uuid,
@@ -216,6 +303,21 @@ simble_srv_init(struct service_desc *s, uint8_t type, uint16_t id)
         };
 };
 
+/* registered services are never released, neither are these */
+struct service_desc *
+simble_srv_alloc(uint8_t type, uint16_t id)
+{
+#if SIMBLE_SRV_POOL_BLOCKS > 0
+        struct service_desc *s = pool_alloc(&simble_srv_pool);
+
+        if (s != NULL)
+                simble_srv_init(s, type, id);
+        return (s);
+#else
+        return (NULL);
+#endif
+}
+
 void
 simble_srv_char_add(struct service_desc *s, struct char_desc *c, uint8_t type, uint16_t id, const char *desc, uint16_t length)
 {
@@ -240,6 +342,13 @@ simble_srv_char_attach_format(struct char_desc *c, uint8_t format, int8_t expone
         };
 }
 
+void
+simble_srv_char_attach_report(struct char_desc *c, struct char_report *r)
+{
+        char_report_reset(r);
+        c->report = r;
+}
+
 void
 simble_srv_char_update(struct char_desc *c, void *val)
 {
@@ -251,8 +360,8 @@ simble_srv_char_update(struct char_desc *c, void *val)
         sd_ble_gatts_value_set(current_conn_handle, c->handles.value_handle, &vt);
 }
 
-uint32_t
-simble_srv_char_notify(struct char_desc *c, bool indicate, uint16_t length, void *val)
+static uint32_t
+srv_hvx(struct char_desc *c, bool indicate, uint16_t length, void *val)
 {
         ble_gatts_hvx_params_t hvx_params = {
                 .handle = c->handles.value_handle,
@@ -261,7 +370,77 @@ simble_srv_char_notify(struct char_desc *c, bool indicate, uint16_t length, void
                 .p_len = &length,
                 .p_data = val,
         };
-        return sd_ble_gatts_hvx(current_conn_handle, &hvx_params);
+
+        return (sd_ble_gatts_hvx(current_conn_handle, &hvx_params));
+}
+
+uint32_t
+simble_srv_char_notify(struct char_desc *c, bool indicate, uint16_t length, void *val)
+{
+        uint32_t r;
+
+        /* suppressed reports are not an error for the caller */
+        if (c->report != NULL && !char_report_due(c, val, length))
+                return (NRF_SUCCESS);
+        r = srv_hvx(c, indicate, length, val);
+        if (r == NRF_SUCCESS && c->report != NULL)
+                char_report_sent(c, val, length);
+        return (r);
+}
+
+static void
+notify_queue_pop(void)
+{
+        pool_free(&simble_payload_pool, notify_queue[notify_head].buf);
+        notify_head = (notify_head + 1) % SIMBLE_PAYLOAD_POOL_BLOCKS;
+        notify_count--;
+}
+
+uint32_t
+simble_srv_char_notify_queued(struct char_desc *c, uint16_t length, void *val)
+{
+        struct notify_entry *e;
+        uint8_t *buf;
+
+        if (c->report != NULL && !char_report_due(c, val, length))
+                return (NRF_SUCCESS);
+        /* later notifications wait behind the queued ones */
+        if (notify_count == 0) {
+                uint32_t r = srv_hvx(c, false, length, val);
+
+                if (r != BLE_ERROR_NO_TX_BUFFERS) {
+                        if (r == NRF_SUCCESS && c->report != NULL)
+                                char_report_sent(c, val, length);
+                        return (r);
+                }
+        }
+        if (length > SIMBLE_PAYLOAD_SIZE)
+                return (NRF_ERROR_DATA_SIZE);
+        buf = pool_alloc(&simble_payload_pool);
+        if (buf == NULL)
+                return (NRF_ERROR_NO_MEM);
+        memcpy(buf, val, length);
+        e = &notify_queue[(notify_head + notify_count++) % SIMBLE_PAYLOAD_POOL_BLOCKS];
+        e->c = c;
+        e->buf = buf;
+        e->len = length;
+        if (c->report != NULL)
+                char_report_sent(c, val, length);
+        return (NRF_SUCCESS);
+}
+
+/* on BLE_EVT_TX_COMPLETE; entries the stack refuses otherwise, e.g.
+   after the peer unsubscribed, are dropped */
+static void
+notify_queue_drain(void)
+{
+        while (notify_count > 0) {
+                struct notify_entry *e = &notify_queue[notify_head];
+
+                if (srv_hvx(e->c, false, e->len, e->buf) == BLE_ERROR_NO_TX_BUFFERS)
+                        break;
+                notify_queue_pop();
+        }
 }
 
 static struct service_desc *
@@ -280,8 +459,11 @@ srv_find_by_uuid(ble_uuid_t *uuid)
 static struct char_desc *
 srv_find_char_by_uuid(struct service_desc *s, ble_uuid_t *uuid)
 {
-        struct char_desc *c = s->chars;
+        struct char_desc *c;
 
+        if (s == NULL)
+                return (NULL);
+        c = s->chars;
         for (int i = 0; i < s->char_count; ++i, ++c) {
                 if (memcmp(&c->uuid, uuid, sizeof(uuid)) == 0)
                         return (c);
@@ -329,7 +511,7 @@ srv_handle_ble_event(ble_evt_t *evt)
                         s = srv_find_by_uuid(&ctx->srvc_uuid);
                         c = srv_find_char_by_uuid(s, &ctx->char_uuid);
                         auth_reply.params.read.gatt_status = BLE_GATT_STATUS_SUCCESS;
-                        if (c->read_cb) {
+                        if (c != NULL && c->read_cb) {
                                 auth_reply.params.read.update = 1;
                                 c->read_cb(s, c, (void*)&auth_reply.params.read.p_data, &auth_reply.params.read.len);
                         }
@@ -341,19 +523,28 @@ srv_handle_ble_event(ble_evt_t *evt)
         }
         case BLE_GAP_EVT_CONNECTED:
                 current_conn_handle = evt->evt.gap_evt.conn_handle;
+                current_conn_interval = evt->evt.gap_evt.params.connected.conn_params.max_conn_interval;
                 srv_foreach_srv(srv_notify_connect);
                 break;
         case BLE_GAP_EVT_DISCONNECTED:
                 current_conn_handle = BLE_CONN_HANDLE_INVALID;
+                current_conn_interval = 0;
+                while (notify_count > 0)
+                        notify_queue_pop();
                 srv_foreach_srv(srv_notify_disconnect);
                 break;
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+                current_conn_interval = evt->evt.gap_evt.params.conn_param_update.conn_params.max_conn_interval;
+                break;
         case BLE_GATTS_EVT_WRITE:
                 s = srv_find_by_uuid(&evt->evt.gatts_evt.params.write.context.srvc_uuid);
                 c = srv_find_char_by_uuid(s, &evt->evt.gatts_evt.params.write.context.char_uuid);
+                if (c == NULL)
+                        break;
                 if (evt->evt.gatts_evt.params.write.handle == c->handles.cccd_handle) {
                         if (c->notify_status_cb)
                                 c->notify_status_cb(s, c, uint16_decode(evt->evt.gatts_evt.params.write.data));
-                } else {
+                } else if (c->write_cb) {
                         c->write_cb(s, c, evt->evt.gatts_evt.params.write.data, evt->evt.gatts_evt.params.write.len);
                 }
                 break;
@@ -370,6 +561,10 @@ srv_handle_ble_event(ble_evt_t *evt)
                         }
                 }
                 break;
+        case BLE_EVT_TX_COMPLETE:
+                if (evt->evt.common_evt.conn_handle == current_conn_handle)
+                        notify_queue_drain();
+                break;
         case BLE_GATTS_EVT_SYS_ATTR_MISSING:
                 sd_ble_gatts_sys_attr_set(current_conn_handle, NULL, 0,
                         BLE_GATTS_SYS_ATTR_FLAG_SYS_SRVCS | BLE_GATTS_SYS_ATTR_FLAG_USR_SRVCS);
@@ -377,42 +572,74 @@ srv_handle_ble_event(ble_evt_t *evt)
         }
 }
 
+/* With S120 the dispatcher also carries central links; the services
+   and advertising only follow the peripheral connection. */
+static bool
+periph_gap_evt(const ble_evt_t *evt, uint16_t conn_handle)
+{
+        switch (evt->header.evt_id) {
+        case BLE_GAP_EVT_CONNECTED:
+#if defined(SD120)
+                return evt->evt.gap_evt.params.connected.role == BLE_GAP_ROLE_PERIPH;
+#else
+                return true;
+#endif
+        case BLE_GAP_EVT_DISCONNECTED:
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+                return evt->evt.gap_evt.conn_handle == conn_handle;
+        default:
+                return true;
+        }
+}
+
 static void
 simble_app_disconnected(void)
 {
         simble_adv_start();
 }
 
+static void
+simble_app_handle_ble_event(ble_evt_t *evt, void *arg)
+{
+        /* the service handler runs first and has forgotten the link */
+        static uint16_t app_conn_handle = BLE_CONN_HANDLE_INVALID;
+
+        if (!periph_gap_evt(evt, app_conn_handle))
+                return;
+        switch (evt->header.evt_id) {
+        case BLE_GAP_EVT_CONNECTED:
+                app_conn_handle = evt->evt.gap_evt.conn_handle;
+                onboard_led(ONBOARD_LED_OFF);
+                break;
+        case BLE_GAP_EVT_DISCONNECTED:
+                app_conn_handle = BLE_CONN_HANDLE_INVALID;
+                simble_app_disconnected();
+                break;
+        }
+}
+
+static void
+srv_evt_cb(ble_evt_t *evt, void *arg)
+{
+        if (periph_gap_evt(evt, current_conn_handle))
+                srv_handle_ble_event(evt);
+}
+
+/* services work with either role, hook them up on first use */
+static void
+srv_evt_register(void)
+{
+        static struct simble_evt_handler common_handler, gap_handler, gatts_handler;
+
+        if (gap_handler.cb != NULL)
+                return;
+        simble_evt_register(&common_handler, SIMBLE_EVT_RANGE_COMMON, srv_evt_cb, NULL);
+        simble_evt_register(&gap_handler, SIMBLE_EVT_RANGE_GAP, srv_evt_cb, NULL);
+        simble_evt_register(&gatts_handler, SIMBLE_EVT_RANGE_GATTS, srv_evt_cb, NULL);
+}
+
 void
 simble_process_event_loop(void)
 {
-        for (;;) {
-                uint32_t r;
-                uint32_t evt;
-
-                sd_app_evt_wait();
-                r = sd_evt_get(&evt);
-
-                struct {
-                        ble_evt_t evt;
-                        uint8_t buf[GATT_MTU_SIZE_DEFAULT];
-                } evt_buf;
-                uint16_t len = sizeof(evt_buf);
-
-                sd_app_evt_wait();
-                r = sd_ble_evt_get((uint8_t *)&evt_buf, &len);
-                sd_nvic_ClearPendingIRQ(SWI2_IRQn);
-                if (r == NRF_SUCCESS) {
-                        srv_handle_ble_event(&evt_buf.evt);
-
-                        switch (evt_buf.evt.header.evt_id) {
-                        case BLE_GAP_EVT_CONNECTED:
-                                onboard_led(ONBOARD_LED_OFF);
-                                break;
-                        case BLE_GAP_EVT_DISCONNECTED:
-                                simble_app_disconnected();
-                                break;
-                        }
-                }
-        }
+        simble_evt_loop();
 }
@@ -8,6 +8,7 @@ enum vendor_uuid {
         VENDOR_UUID_SENSOR_SERVICE = 0x1801,
         VENDOR_UUID_IND_SERVICE = 0x1802,
         VENDOR_UUID_SENSOR_TEMP_SERVICE = 0x1803,
+        VENDOR_UUID_BENCH_SERVICE = 0x1810,
         VENDOR_UUID_TEMP_CHAR = 0x2301,
         VENDOR_UUID_HUMID_CHAR = 0x2302,
         VENDOR_UUID_MOTION_CHAR = 0x2303,
@@ -20,15 +21,21 @@ enum vendor_uuid {
         VENDOR_UUID_IR_CHAR = 0x230b,
         VENDOR_UUID_RAW_CHAR = 0x230c,
         VENDOR_UUID_SAMPLING_PERIOD_CHAR = 0x2400,
+        VENDOR_UUID_ENERGY_CHAR = 0x2401,
+        VENDOR_UUID_BENCH_CTRL_CHAR = 0x2410,
+        VENDOR_UUID_BENCH_DATA_CHAR = 0x2411,
+        VENDOR_UUID_BENCH_STATS_CHAR = 0x2412,
 };
 
 enum org_bluetooth_unit {
         ORG_BLUETOOTH_UNIT_UNITLESS = 0x2700,
+        ORG_BLUETOOTH_UNIT_SECOND = 0x2703,
         ORG_BLUETOOTH_UNIT_DEGREE_CELSIUS = 0x272f,
         ORG_BLUETOOTH_UNIT_PERCENTAGE = 0x27AD,
 };
 
 struct char_desc;
+struct char_report;
 struct service_desc;
 
 typedef void (char_notify_status_cb_t)(struct service_desc *s, struct char_desc *c, const int8_t status);
@@ -49,6 +56,7 @@ struct char_desc {
         char_read_cb_t *read_cb;
         char_indicated_cb_t *indicated_cb;
         char_notify_status_cb_t *notify_status_cb;
+        struct char_report *report;
         void *data;
         union {
                 struct {
@@ -71,16 +79,48 @@ struct service_desc {
 };
 
 
+/* Shared pools, sizes can be overridden from the build; the arrays
+   are reserved statically.  Payload blocks hold one default MTU
+   notification.  sensor_serv keeps one per sensor found present as its
+   value buffer; simble_srv_char_notify_queued() borrows the others
+   while a notification waits for a TX buffer, so unfitted sensors
+   leave their blocks to the queue.  Service blocks hold a
+   service_desc with SIMBLE_SRV_POOL_CHARS characteristics, for
+   services created at runtime; without SIMBLE_SRV_POOL_BLOCKS there
+   is no service pool and simble_srv_alloc() returns NULL. */
+#ifndef SIMBLE_PAYLOAD_POOL_BLOCKS
+#define SIMBLE_PAYLOAD_POOL_BLOCKS 8
+#endif
+#ifndef SIMBLE_SRV_POOL_BLOCKS
+#define SIMBLE_SRV_POOL_BLOCKS 0
+#endif
+#define SIMBLE_SRV_POOL_CHARS 4
+#define SIMBLE_PAYLOAD_SIZE (GATT_MTU_SIZE_DEFAULT - 3)
+
+struct pool;
+extern struct pool simble_payload_pool;
+#if SIMBLE_SRV_POOL_BLOCKS > 0
+extern struct pool simble_srv_pool;
+#endif
+
 void simble_init(const char *name);
 void simble_adv_start(void);
 uint8_t simble_get_vendor_uuid_class(void);
+uint16_t simble_get_conn_interval(void);
 void simble_process_event_loop(void) __attribute__ ((noreturn));
 
 void simble_srv_register(struct service_desc *s);
 void simble_srv_init(struct service_desc *s, uint8_t type, uint16_t id);
+struct service_desc *simble_srv_alloc(uint8_t type, uint16_t id);
 void simble_srv_char_add(struct service_desc *s, struct char_desc *c, uint8_t type, uint16_t id, const char *desc, uint16_t length);
 void simble_srv_char_attach_format(struct char_desc *c, uint8_t format, int8_t exponent, uint16_t unit);
+void simble_srv_char_attach_report(struct char_desc *c, struct char_report *r);
 void simble_srv_char_update(struct char_desc *c, void *val);
 uint32_t simble_srv_char_notify(struct char_desc *c, bool indicate, uint16_t length, void *val);
+/* A notification the stack has no TX buffer for is copied into a
+   simble_payload_pool block and sent on the next BLE_EVT_TX_COMPLETE,
+   after those queued before it; NRF_ERROR_NO_MEM without a free block.
+   The queue is dropped on disconnect.  Event loop context only. */
+uint32_t simble_srv_char_notify_queued(struct char_desc *c, uint16_t length, void *val);
 
 #endif
@@ -0,0 +1,60 @@
+#include <stdbool.h>
+
+#include <nrf.h>
+
+#include "simble_boot.h"
+#include "segger_rtt_init.h"
+
+#define BOOT_UNMARKED   0xffffffffu
+#define BOOT_TICKS_TO_US(t)     ((uint32_t)(((uint64_t)(t) * 15625) >> 9)) /* 1e6 / 32768 */
+
+static uint32_t boot_ticks[SIMBLE_BOOT_NUM];
+static bool boot_running;
+
+void
+simble_boot_start(void)
+{
+        for (int i = 0; i < SIMBLE_BOOT_NUM; i++)
+                boot_ticks[i] = BOOT_UNMARKED;
+
+        NRF_RTC1->TASKS_STOP = 1;
+        NRF_RTC1->PRESCALER = 0;
+        NRF_RTC1->TASKS_CLEAR = 1;
+        NRF_RTC1->TASKS_START = 1;
+        boot_ticks[SIMBLE_BOOT_SD_ENABLED] = 0;
+        boot_running = true;
+}
+
+void
+simble_boot_stop(void)
+{
+        boot_running = false;
+}
+
+void
+simble_boot_mark(enum simble_boot_phase phase)
+{
+        if (!boot_running)
+                return;
+        if (boot_ticks[phase] == BOOT_UNMARKED)
+                boot_ticks[phase] = NRF_RTC1->COUNTER;
+}
+
+void
+simble_boot_report(void)
+{
+        static const char *const names[SIMBLE_BOOT_NUM] = {
+                "softdevice enabled", "ble enabled", "early advertising",
+                "gatt base", "gatt done", "connectable advertising",
+        };
+        uint32_t prev = 0;
+
+        for (int i = 0; i < SIMBLE_BOOT_NUM; i++) {
+                if (boot_ticks[i] == BOOT_UNMARKED)
+                        continue;
+                segger_rtt_printf("boot: %s at %u us (+%u us)\n", names[i],
+                                  BOOT_TICKS_TO_US(boot_ticks[i]),
+                                  BOOT_TICKS_TO_US(boot_ticks[i] - prev));
+                prev = boot_ticks[i];
+        }
+}
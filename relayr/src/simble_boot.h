@@ -0,0 +1,28 @@
+#ifndef SIMBLE_BOOT_H
+#define SIMBLE_BOOT_H
+
+/* Startup phase timing.
+ *
+ * RTC1 runs unprescaled (30.5 us) from the moment the SoftDevice has
+ * started the LFCLK until rtc_init() takes it over; phases marked
+ * after that are not recorded, so call rtc_init() after
+ * simble_adv_start() to time the whole startup.  Each phase keeps its
+ * first mark. */
+
+enum simble_boot_phase {
+        SIMBLE_BOOT_SD_ENABLED,         /* time 0 */
+        SIMBLE_BOOT_BLE_ENABLED,
+        SIMBLE_BOOT_ADV_EARLY,          /* SIMBLE_FAST_START only */
+        SIMBLE_BOOT_GATT_BASE,          /* TX power service, vendor UUID */
+        SIMBLE_BOOT_GATT_DONE,          /* application services */
+        SIMBLE_BOOT_ADV_CONNECTABLE,
+        SIMBLE_BOOT_NUM
+};
+
+void simble_boot_start(void);
+/* rtc_init() calls this before it takes over RTC1 */
+void simble_boot_stop(void);
+void simble_boot_mark(enum simble_boot_phase phase);
+void simble_boot_report(void);
+
+#endif
@@ -4,73 +4,851 @@
 #include <nrf_sdm.h>
 #include <pstorage.h>
 #include <ble_gap.h>
+#include <ble_hci.h>
+#include <string.h>
 
-const uint32_t BLE_EVT_BUF_SIZE = (sizeof(ble_evt_t) + (GATT_MTU_SIZE_DEFAULT));
+#include "rtc.h"
+#include "simble_evt.h"
+#include "simble_central_aggr.h"
+#include "segger_rtt_init.h"
 
 struct simble_central_ctx_t *global_ctx;
 
+static struct simble_evt_handler dm_handler, conn_mgr_handler, app_handler;
+static struct simble_soc_evt_handler pstorage_handler;
+static struct simble_idle_handler conn_mgr_idle;
+/* one timer for the earliest re-encryption deadline of all links */
+static volatile bool encrypt_timer_armed;
+
+/* connection manager tuning */
+#define CONN_MGR_CONNECT_TIMEOUT	2	/* s, per connect attempt */
+#define CONN_MGR_HOLDOFF_MS		300	/* scan only time after each attempt */
+#define CONN_MGR_BACKOFF_MIN_MS		250
+#define CONN_MGR_BACKOFF_MAX_MS		60000
+#define CONN_MGR_STABLE_MS		10000	/* links shorter than this count as failures */
+#define LINK_ENCRYPT_TIMEOUT_MS		3000	/* bonded link not encrypted by then goes ahead open */
+
+/* scan scheduler tuning */
+#define SCAN_HUNT_MS		30000	/* full window after a peer went missing */
+#define SCAN_BACKGROUND_DIV	4	/* window divider in background */
+#define SCAN_WINDOW_MIN		0x0004	/* 2.5 ms */
+#define SCAN_LINK_EVENT_US	2500	/* airtime per link and connection interval */
+#define SCAN_RATE_PERIOD_MS	1000
+#define SCAN_PASSIVE_ENTER_RATE	40	/* ADV reports/s, above this no scan requests */
+#define SCAN_PASSIVE_LEAVE_RATE	10	/* back to active below this, passive halves the rate */
+
+static bool addr_equal(const ble_gap_addr_t *a, const ble_gap_addr_t *b);
+static struct simble_central_peer *conn_mgr_find_addr(struct simble_central_conn_mgr *mgr,
+	const ble_gap_addr_t *addr);
+static void link_encrypt_expire(struct simble_central_ctx_t *ctx, uint32_t now);
+
+static struct simble_central_link *
+link_find(struct simble_central_ctx_t *ctx, uint8_t connection_id)
+{
+	for (int i = 0; i < SIMBLE_CENTRAL_MAX_LINKS; i++) {
+		struct simble_central_link *l = &ctx->links[i];
+		if (l->conn_handle != BLE_CONN_HANDLE_INVALID &&
+		    l->dm_handle.connection_id == connection_id) {
+			return l;
+		}
+	}
+	return NULL;
+}
+
+static struct simble_central_link *
+link_find_conn(struct simble_central_ctx_t *ctx, uint16_t conn_handle)
+{
+	for (int i = 0; i < SIMBLE_CENTRAL_MAX_LINKS; i++) {
+		if (ctx->links[i].conn_handle == conn_handle) {
+			return &ctx->links[i];
+		}
+	}
+	return NULL;
+}
+
+static int
+bond_find(struct simble_central_bonds *bonds, const ble_gap_addr_t *addr)
+{
+	for (int i = 0; i < bonds->count; i++) {
+		if (addr_equal(&bonds->addr[i], addr)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void
+bond_remove(struct simble_central_bonds *bonds, uint8_t device_id)
+{
+	for (int i = 0; i < bonds->count; i++) {
+		if (bonds->device_id[i] == device_id) {
+			bonds->count--;
+			bonds->addr[i] = bonds->addr[bonds->count];
+			bonds->device_id[i] = bonds->device_id[bonds->count];
+			return;
+		}
+	}
+}
+
+static void
+bond_add(struct simble_central_bonds *bonds, const dm_handle_t *handle)
+{
+	ble_gap_addr_t addr;
+
+	if (dm_peer_addr_get(handle, &addr) != NRF_SUCCESS) {
+		return;
+	}
+	bond_remove(bonds, handle->device_id);
+	if (bonds->count < SIMBLE_CENTRAL_MAX_BONDS) {
+		bonds->addr[bonds->count] = addr;
+		bonds->device_id[bonds->count] = handle->device_id;
+		bonds->count++;
+	}
+}
+
+static void
+bond_index_load(struct simble_central_ctx_t *ctx)
+{
+	ctx->bonds.count = 0;
+	for (int i = 0; i < SIMBLE_CENTRAL_MAX_BONDS; i++) {
+		/* no connection: dm_peer_addr_get() reads the bond table */
+		dm_handle_t handle = {
+			.appl_id = ctx->app_id,
+			.connection_id = DM_INVALID_ID,
+			.device_id = i,
+			.service_id = DM_INVALID_ID,
+		};
+		bond_add(&ctx->bonds, &handle);
+	}
+}
+
+static void
+link_set_ready(struct simble_central_ctx_t *ctx, struct simble_central_link *l)
+{
+	if (l->ready) {
+		return;
+	}
+	l->ready = true;
+	if (ctx->aggr != NULL) {
+		simble_central_aggr_link_ready(ctx, l->conn_handle);
+	}
+	if (ctx->link_ready_cb) {
+		ctx->link_ready_cb(ctx, l->conn_handle);
+	}
+}
+
+static void
+link_encrypt_timeout_cb(struct rtc_ctx *rtc)
+{
+	/* only wakes the event loop, which does the fallback and re-arms */
+	encrypt_timer_armed = false;
+}
+
+static void
+link_connected(struct simble_central_ctx_t *ctx, dm_handle_t const *p_handle,
+	const ble_gap_evt_t *gap_evt)
+{
+	struct simble_central_link *l = link_find_conn(ctx, BLE_CONN_HANDLE_INVALID);
+
+	if (l == NULL) {
+		return;
+	}
+	*l = (struct simble_central_link){
+		.conn_handle = gap_evt->conn_handle,
+		.sec_state = SIMBLE_SEC_OPEN,
+		.role = gap_evt->params.connected.role,
+		.dm_handle = *p_handle,
+		.addr = gap_evt->params.connected.peer_addr,
+		.connected_at = rtc_now(),
+	};
+	/* known peer: encrypt with the stored LTK before any GATT traffic */
+	if (bond_find(&ctx->bonds, &l->addr) >= 0 &&
+	    dm_security_setup_req(&l->dm_handle) == NRF_SUCCESS) {
+		l->sec_state = SIMBLE_SEC_ENCRYPTING;
+		link_encrypt_expire(ctx, l->connected_at);
+	} else {
+		link_set_ready(ctx, l);
+	}
+}
+
+static void
+link_secured(struct simble_central_ctx_t *ctx, struct simble_central_link *l)
+{
+	struct simble_central_peer *p = conn_mgr_find_addr(&ctx->conn_mgr, &l->addr);
+	uint32_t t = rtc_now() - l->connected_at;
+
+	if (l->sec_state == SIMBLE_SEC_ENCRYPTING && p != NULL) {
+		p->encrypts++;
+		p->encrypt_last = t;
+		p->encrypt_total += t;
+		if (t > p->encrypt_max) {
+			p->encrypt_max = t;
+		}
+	}
+	l->sec_state = SIMBLE_SEC_ENCRYPTED;
+	link_set_ready(ctx, l);
+}
+
 static ret_code_t
 device_manager_event_handler(dm_handle_t const *p_handle,
 	dm_event_t const *p_event, ret_code_t event_result)
 
 {
-	APP_ERROR_CHECK(event_result);
+	struct simble_central_ctx_t *ctx = global_ctx;
+	struct simble_central_link *l = link_find(ctx, p_handle->connection_id);
 	uint32_t err_code;
+
 	switch(p_event->event_id) {
 	case DM_EVT_CONNECTION:
-		if (global_ctx->connect_cb) {
-			global_ctx->connect_cb(p_handle, p_event);
+		APP_ERROR_CHECK(event_result);
+		link_connected(ctx, p_handle, p_event->event_param.p_gap_param);
+		if (ctx->connect_cb) {
+			ctx->connect_cb(p_handle, p_event);
 		}
 		break;
 	case DM_EVT_DISCONNECTION:
-		if (global_ctx->disconnect_cb) {
-			global_ctx->disconnect_cb(p_handle, p_event);
+		if (l != NULL) {
+			l->conn_handle = BLE_CONN_HANDLE_INVALID;
+			l->gattc_owner = NULL;
+		}
+		if (ctx->disconnect_cb) {
+			ctx->disconnect_cb(p_handle, p_event);
 		}
 		break;
 	case DM_EVT_LINK_SECURED:
+		if (l != NULL && event_result == NRF_SUCCESS) {
+			link_secured(ctx, l);
+		}
 		break;
-	case DM_EVT_SECURITY_SETUP: /* won't fire for previously bonded devices */
+	case DM_EVT_SECURITY_SETUP: /* peer security request */
+		if (l != NULL && l->sec_state != SIMBLE_SEC_OPEN) {
+			break;
+		}
 		err_code = dm_security_setup_req((dm_handle_t*)p_handle);
 		APP_ERROR_CHECK(err_code);
-	case DM_EVT_SECURITY_SETUP_COMPLETE: /* won't fire for previously bonded devices */
+		break;
+	case DM_EVT_SECURITY_SETUP_COMPLETE:
+		/* a failed re-encryption (e.g. the peer lost its keys) leaves
+		   the link unencrypted, GATT goes ahead */
+		if (l != NULL && event_result != NRF_SUCCESS) {
+			l->sec_state = SIMBLE_SEC_OPEN;
+			link_set_ready(ctx, l);
+		}
 		break;
 	case DM_EVT_SECURITY_SETUP_REFRESH:
 		break;
-	case DM_EVT_DEVICE_CONTEXT_LOADED:
 	case DM_EVT_DEVICE_CONTEXT_STORED:
+		if (event_result == NRF_SUCCESS) {
+			bond_add(&ctx->bonds, p_handle);
+		}
+		break;
 	case DM_EVT_DEVICE_CONTEXT_DELETED:
+		bond_remove(&ctx->bonds, p_handle->device_id);
+		break;
+	case DM_EVT_DEVICE_CONTEXT_LOADED:
 	case DM_EVT_SERVICE_CONTEXT_LOADED:
 	case DM_EVT_SERVICE_CONTEXT_STORED:
 	case DM_EVT_SERVICE_CONTEXT_DELETED:
 	case DM_EVT_APPL_CONTEXT_LOADED:
 	case DM_EVT_APPL_CONTEXT_STORED:
 	case DM_EVT_APPL_CONTEXT_DELETED:
+		APP_ERROR_CHECK(event_result);
 		break;
 	}
 	return NRF_SUCCESS;
 }
 
+static bool
+addr_equal(const ble_gap_addr_t *a, const ble_gap_addr_t *b)
+{
+	return a->addr_type == b->addr_type &&
+		memcmp(a->addr, b->addr, BLE_GAP_ADDR_LEN) == 0;
+}
+
+static bool
+time_reached(uint32_t deadline, uint32_t now)
+{
+	return (int32_t)(now - deadline) >= 0;
+}
+
+static struct simble_central_peer *
+conn_mgr_find_addr(struct simble_central_conn_mgr *mgr, const ble_gap_addr_t *addr)
+{
+	for (int i = 0; i < mgr->peer_count; i++) {
+		struct simble_central_peer *p = &mgr->peers[i];
+		if (p->state != SIMBLE_LINK_UNUSED && addr_equal(&p->addr, addr)) {
+			return p;
+		}
+	}
+	return NULL;
+}
+
+/* a bonded peer that neither completes nor fails the re-encryption
+   would keep its link from ever getting ready; give it up as open.
+   The timer is armed for the earliest deadline left; a link added
+   later has a later one, so an armed timer is never too late. */
+static void
+link_encrypt_expire(struct simble_central_ctx_t *ctx, uint32_t now)
+{
+	uint32_t next = 0;
+	bool waiting = false;
+
+	for (int i = 0; i < SIMBLE_CENTRAL_MAX_LINKS; i++) {
+		struct simble_central_link *l = &ctx->links[i];
+		uint32_t deadline = l->connected_at + RTC_MS_TO_TICKS(LINK_ENCRYPT_TIMEOUT_MS);
+
+		if (l->conn_handle == BLE_CONN_HANDLE_INVALID ||
+		    l->sec_state != SIMBLE_SEC_ENCRYPTING) {
+			continue;
+		}
+		if (time_reached(deadline, now)) {
+			l->sec_state = SIMBLE_SEC_OPEN;
+			link_set_ready(ctx, l);
+		} else if (!waiting || (int32_t)(deadline - next) < 0) {
+			next = deadline;
+			waiting = true;
+		}
+	}
+	/* without a free timer the deadline is checked on the next event */
+	if (waiting && !encrypt_timer_armed &&
+	    rtc_oneshot_timer(next - now, link_encrypt_timeout_cb)) {
+		encrypt_timer_armed = true;
+	}
+}
+
+/* every central link counts against the SoftDevice limit, managed or
+   not, and so does a connection being set up */
+static uint8_t
+conn_mgr_link_count(struct simble_central_ctx_t *ctx)
+{
+	uint8_t n = ctx->conn_mgr.connecting >= 0;
+
+	for (int i = 0; i < SIMBLE_CENTRAL_MAX_LINKS; i++) {
+		struct simble_central_link *l = &ctx->links[i];
+		if (l->conn_handle != BLE_CONN_HANDLE_INVALID && l->role == BLE_GAP_ROLE_CENTRAL) {
+			n++;
+		}
+	}
+	return n;
+}
+
+static bool
+conn_mgr_missing_peers(struct simble_central_conn_mgr *mgr)
+{
+	for (int i = 0; i < mgr->peer_count; i++) {
+		uint8_t state = mgr->peers[i].state;
+		if (state == SIMBLE_LINK_IDLE || state == SIMBLE_LINK_BACKOFF) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void
+conn_mgr_failed(struct simble_central_peer *p, uint32_t now)
+{
+	uint32_t backoff = RTC_MS_TO_TICKS(CONN_MGR_BACKOFF_MIN_MS);
+	uint32_t max = RTC_MS_TO_TICKS(CONN_MGR_BACKOFF_MAX_MS);
+
+	if (p->failures < UINT8_MAX) {
+		p->failures++;
+	}
+	for (int i = 1; i < p->failures && backoff < max; i++) {
+		backoff <<= 1;
+	}
+	if (backoff > max) {
+		backoff = max;
+	}
+	p->state = SIMBLE_LINK_BACKOFF;
+	p->retry_at = now + backoff;
+}
+
+static void
+conn_mgr_missing(struct simble_central_ctx_t *ctx, struct simble_central_peer *p, uint32_t now)
+{
+	p->seen = false;
+	p->missing_since = now;
+	ctx->scan.hunt_since = now;
+}
+
+/* the scheduler owns scanning once the connection manager is in use;
+   a scan the application started ends at its timeout */
+static bool
+scan_managed(struct simble_central_ctx_t *ctx)
+{
+	return ctx->conn_mgr.started || ctx->conn_mgr.peer_count > 0;
+}
+
+static uint8_t
+scan_plan(struct simble_central_ctx_t *ctx, ble_gap_scan_params_t *params, uint32_t now)
+{
+	struct simble_central_conn_mgr *mgr = &ctx->conn_mgr;
+	struct simble_central_scan *scan = &ctx->scan;
+	uint32_t hunt_end = scan->hunt_since + RTC_MS_TO_TICKS(SCAN_HUNT_MS);
+	uint8_t link_count = conn_mgr_link_count(ctx);
+	bool ready = false;	/* a missing peer may be connected right away */
+
+	*params = ctx->scan_params;
+	if (mgr->peer_count == 0) {
+		return SIMBLE_SCAN_HUNT;
+	}
+	if (link_count >= SIMBLE_CENTRAL_MAX_LINKS || !conn_mgr_missing_peers(mgr)) {
+		return SIMBLE_SCAN_OFF;
+	}
+	for (int i = 0; i < mgr->peer_count; i++) {
+		struct simble_central_peer *p = &mgr->peers[i];
+		if (p->state == SIMBLE_LINK_IDLE ||
+		    (p->state == SIMBLE_LINK_BACKOFF && time_reached(p->retry_at, now))) {
+			ready = true;
+		}
+	}
+
+	uint8_t mode = SIMBLE_SCAN_BACKGROUND;
+	uint32_t window = params->window;
+	if (ready && !time_reached(hunt_end, now)) {
+		/* time out at the end of the hunt to drop to background */
+		uint16_t left = (RTC_TICKS_TO_MS(hunt_end - now) + 999) / 1000;
+		if (params->timeout == 0 || params->timeout > left) {
+			params->timeout = left;
+		}
+		mode = SIMBLE_SCAN_HUNT;
+	} else {
+		window /= SCAN_BACKGROUND_DIV;
+	}
+	/* leave the connection events their airtime */
+	uint32_t conn_us = (uint32_t)ctx->conn_params.max_conn_interval * 1250;
+	uint32_t link_us = (uint32_t)link_count * SCAN_LINK_EVENT_US;
+	if (link_us > 0) {
+		window = link_us >= conn_us ? 0 :
+			(uint64_t)window * (conn_us - link_us) / conn_us;
+	}
+	if (window < SCAN_WINDOW_MIN) {
+		window = SCAN_WINDOW_MIN;
+	}
+	params->window = window;
+	if (scan->passive) {
+		params->active = 0;
+	}
+	return mode;
+}
+
+static void
+scan_stopped(struct simble_central_scan *scan, uint32_t now)
+{
+	uint32_t t = now - scan->started_at;
+
+	if (!scan->running) {
+		return;
+	}
+	scan->running = false;
+	scan->on_time += t;
+	scan->duty_time += (uint64_t)t * scan->params.window / scan->params.interval;
+}
+
+static void
+scan_update(struct simble_central_ctx_t *ctx)
+{
+	struct simble_central_scan *scan = &ctx->scan;
+	uint32_t now = rtc_now();
+	ble_gap_scan_params_t params;
+	uint8_t mode = scan_plan(ctx, &params, now);
+
+	scan->pending = false;
+	if (scan->running) {
+		if (mode == scan->mode &&
+		    params.active == scan->params.active &&
+		    params.interval == scan->params.interval &&
+		    params.window == scan->params.window) {
+			return;
+		}
+		sd_ble_gap_scan_stop();
+		scan_stopped(scan, now);
+	}
+	scan->mode = mode;
+	if (mode == SIMBLE_SCAN_OFF) {
+		return;
+	}
+	scan->params = params;
+	uint32_t err_code = sd_ble_gap_scan_start(&scan->params);
+	// NRF_ERROR_BUSY The stack is busy, process pending events and retry.
+	if (err_code == NRF_ERROR_BUSY) {
+		scan->busy++;
+		scan->pending = true;
+		return;
+	}
+	// NRF_ERROR_INVALID_STATE Already scanning, started outside of the scheduler
+	if (err_code != NRF_ERROR_INVALID_STATE) {
+		APP_ERROR_CHECK(err_code);
+	}
+	scan->running = true;
+	scan->started_at = now;
+}
+
+static void
+scan_discovered(struct simble_central_scan *scan, struct simble_central_peer *p, uint32_t now)
+{
+	uint32_t t = now - p->missing_since;
+
+	if (p->seen || (p->state != SIMBLE_LINK_IDLE && p->state != SIMBLE_LINK_BACKOFF)) {
+		return;
+	}
+	p->seen = true;
+	scan->discoveries++;
+	scan->discover_last = t;
+	scan->discover_total += t;
+	if (t > scan->discover_max) {
+		scan->discover_max = t;
+	}
+}
+
+static void
+scan_handle_ble_event(struct simble_central_ctx_t *ctx, ble_evt_t *evt)
+{
+	const ble_gap_evt_t *gap_evt = &evt->evt.gap_evt;
+
+	switch (evt->header.evt_id) {
+	case BLE_GAP_EVT_ADV_REPORT:
+		ctx->scan.reports++;
+		break;
+	case BLE_GAP_EVT_TIMEOUT:
+		if (gap_evt->params.timeout.src == BLE_GAP_TIMEOUT_SRC_SCAN) {
+			scan_stopped(&ctx->scan, rtc_now());
+		}
+		break;
+	}
+}
+
+static void
+conn_mgr_adv_report(struct simble_central_ctx_t *ctx, const ble_gap_evt_t *gap_evt)
+{
+	struct simble_central_conn_mgr *mgr = &ctx->conn_mgr;
+	uint32_t now = rtc_now();
+	struct simble_central_peer *p = conn_mgr_find_addr(mgr, &gap_evt->params.adv_report.peer_addr);
+
+	if (p == NULL) {
+		return;
+	}
+	scan_discovered(&ctx->scan, p, now);
+	if (mgr->connecting >= 0 || conn_mgr_link_count(ctx) >= SIMBLE_CENTRAL_MAX_LINKS ||
+	    !time_reached(mgr->holdoff_until, now)) {
+		return;
+	}
+	if (p->state != SIMBLE_LINK_IDLE &&
+	    !(p->state == SIMBLE_LINK_BACKOFF && time_reached(p->retry_at, now))) {
+		return;
+	}
+
+	ble_gap_scan_params_t scan_params = ctx->scan_params;
+	scan_params.timeout = CONN_MGR_CONNECT_TIMEOUT;
+	uint32_t err_code = sd_ble_gap_connect(&p->addr, &scan_params, &ctx->conn_params);
+	if (err_code == NRF_SUCCESS) {
+		/* the SoftDevice stops scanning to connect */
+		scan_stopped(&ctx->scan, now);
+		p->state = SIMBLE_LINK_CONNECTING;
+		mgr->connecting = p - mgr->peers;
+	} else if (err_code != NRF_ERROR_BUSY) {
+		conn_mgr_failed(p, now);
+	}
+}
+
+static void
+conn_mgr_handle_ble_event(struct simble_central_ctx_t *ctx, ble_evt_t *evt)
+{
+	struct simble_central_conn_mgr *mgr = &ctx->conn_mgr;
+	const ble_gap_evt_t *gap_evt = &evt->evt.gap_evt;
+	struct simble_central_peer *p;
+	uint32_t now;
+
+	if (mgr->peer_count == 0) {
+		return;
+	}
+	switch (evt->header.evt_id) {
+	case BLE_GAP_EVT_ADV_REPORT:
+		conn_mgr_adv_report(ctx, gap_evt);
+		break;
+	case BLE_GAP_EVT_CONNECTED:
+		now = rtc_now();
+		p = conn_mgr_find_addr(mgr, &gap_evt->params.connected.peer_addr);
+		if (p == NULL) {
+			break;
+		}
+		if (mgr->connecting == p - mgr->peers) {
+			mgr->connecting = -1;
+		}
+		p->conn_handle = gap_evt->conn_handle;
+		if (p->state == SIMBLE_LINK_REMOVING) {
+			sd_ble_gap_disconnect(p->conn_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
+			break;
+		}
+		p->state = SIMBLE_LINK_CONNECTED;
+		p->connected_at = now;
+		p->connects++;
+		mgr->holdoff_until = now + RTC_MS_TO_TICKS(CONN_MGR_HOLDOFF_MS);
+		scan_update(ctx);
+		break;
+	case BLE_GAP_EVT_DISCONNECTED:
+		now = rtc_now();
+		p = simble_central_peer_find(ctx, gap_evt->conn_handle);
+		if (p == NULL) {
+			break;
+		}
+		p->conn_handle = BLE_CONN_HANDLE_INVALID;
+		p->last_reason = gap_evt->params.disconnected.reason;
+		if (p->state == SIMBLE_LINK_REMOVING) {
+			p->state = SIMBLE_LINK_UNUSED;
+		} else {
+			uint32_t session = now - p->connected_at;
+			p->uptime += session;
+			if (session < RTC_MS_TO_TICKS(CONN_MGR_STABLE_MS)) {
+				conn_mgr_failed(p, now);
+			} else {
+				p->failures = 0;
+				p->state = SIMBLE_LINK_IDLE;
+			}
+			conn_mgr_missing(ctx, p, now);
+		}
+		scan_update(ctx);
+		break;
+	case BLE_GAP_EVT_TIMEOUT:
+		if (gap_evt->params.timeout.src == BLE_GAP_TIMEOUT_SRC_CONN && mgr->connecting >= 0) {
+			now = rtc_now();
+			p = &mgr->peers[mgr->connecting];
+			mgr->connecting = -1;
+			if (p->state == SIMBLE_LINK_CONNECTING) {
+				conn_mgr_failed(p, now);
+			} else if (p->state == SIMBLE_LINK_REMOVING) {
+				/* removed while the cancel raced the timeout */
+				p->state = SIMBLE_LINK_UNUSED;
+			}
+			mgr->holdoff_until = now + RTC_MS_TO_TICKS(CONN_MGR_HOLDOFF_MS);
+			scan_update(ctx);
+		} else if (gap_evt->params.timeout.src == BLE_GAP_TIMEOUT_SRC_SCAN &&
+		    scan_managed(ctx)) {
+			scan_update(ctx);
+		}
+		break;
+	}
+}
+
+int
+simble_central_peer_add(struct simble_central_ctx_t *ctx, const ble_gap_addr_t *addr)
+{
+	struct simble_central_conn_mgr *mgr = &ctx->conn_mgr;
+	int idx;
+
+	for (idx = 0; idx < mgr->peer_count; idx++) {
+		if (mgr->peers[idx].state == SIMBLE_LINK_UNUSED) {
+			break;
+		}
+	}
+	if (idx == SIMBLE_CENTRAL_MAX_PEERS) {
+		return -1;
+	}
+	if (idx == mgr->peer_count) {
+		mgr->peer_count++;
+	}
+	mgr->peers[idx] = (struct simble_central_peer){
+		.addr = *addr,
+		.state = SIMBLE_LINK_IDLE,
+		.conn_handle = BLE_CONN_HANDLE_INVALID,
+	};
+	conn_mgr_missing(ctx, &mgr->peers[idx], rtc_now());
+	return idx;
+}
+
+void
+simble_central_peer_remove(struct simble_central_ctx_t *ctx, int idx)
+{
+	struct simble_central_peer *p = &ctx->conn_mgr.peers[idx];
+
+	switch (p->state) {
+	case SIMBLE_LINK_CONNECTED:
+		p->state = SIMBLE_LINK_REMOVING;
+		sd_ble_gap_disconnect(p->conn_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
+		break;
+	case SIMBLE_LINK_CONNECTING:
+		if (sd_ble_gap_connect_cancel() == NRF_SUCCESS) {
+			ctx->conn_mgr.connecting = -1;
+			p->state = SIMBLE_LINK_UNUSED;
+			scan_update(ctx);
+		} else {
+			/* already connected, the event is pending */
+			p->state = SIMBLE_LINK_REMOVING;
+		}
+		break;
+	case SIMBLE_LINK_REMOVING:
+		break;
+	default:
+		p->state = SIMBLE_LINK_UNUSED;
+		break;
+	}
+}
+
+struct simble_central_peer *
+simble_central_peer_find(struct simble_central_ctx_t *ctx, uint16_t conn_handle)
+{
+	struct simble_central_conn_mgr *mgr = &ctx->conn_mgr;
+
+	for (int i = 0; i < mgr->peer_count; i++) {
+		struct simble_central_peer *p = &mgr->peers[i];
+		if (p->state != SIMBLE_LINK_UNUSED && p->conn_handle == conn_handle) {
+			return p;
+		}
+	}
+	return NULL;
+}
+
+uint32_t
+simble_central_peer_uptime(struct simble_central_ctx_t *ctx, int idx)
+{
+	struct simble_central_peer *p = &ctx->conn_mgr.peers[idx];
+
+	if (p->state == SIMBLE_LINK_CONNECTED) {
+		return p->uptime + (rtc_now() - p->connected_at);
+	}
+	return p->uptime;
+}
+
+void
+simble_central_conn_mgr_start(struct simble_central_ctx_t *ctx)
+{
+	uint32_t now = rtc_now();
+
+	ctx->conn_mgr.started = true;
+	ctx->conn_mgr.holdoff_until = now;
+	ctx->scan.stats_since = now;
+	ctx->scan.rate_at = now;
+	ctx->scan.hunt_since = now;
+	scan_update(ctx);
+}
+
+bool
+simble_central_link_ready(struct simble_central_ctx_t *ctx, uint16_t conn_handle)
+{
+	struct simble_central_link *l = link_find_conn(ctx, conn_handle);
+
+	return l != NULL && l->ready;
+}
+
+bool
+simble_central_gattc_claim(struct simble_central_ctx_t *ctx, uint16_t conn_handle, const void *owner)
+{
+	struct simble_central_link *l = link_find_conn(ctx, conn_handle);
+
+	if (l == NULL || (l->gattc_owner != NULL && l->gattc_owner != owner)) {
+		return false;
+	}
+	l->gattc_owner = owner;
+	return true;
+}
+
+void
+simble_central_gattc_release(struct simble_central_ctx_t *ctx, uint16_t conn_handle, const void *owner)
+{
+	struct simble_central_link *l = link_find_conn(ctx, conn_handle);
+
+	if (l != NULL && l->gattc_owner == owner) {
+		l->gattc_owner = NULL;
+	}
+}
+
+bool
+simble_central_gattc_owned(struct simble_central_ctx_t *ctx, uint16_t conn_handle, const void *owner)
+{
+	struct simble_central_link *l = link_find_conn(ctx, conn_handle);
+
+	return l != NULL && l->gattc_owner == owner;
+}
+
+bool
+simble_central_bonded(struct simble_central_ctx_t *ctx, const ble_gap_addr_t *addr)
+{
+	return bond_find(&ctx->bonds, addr) >= 0;
+}
+
+void
+simble_central_sec_report(struct simble_central_ctx_t *ctx)
+{
+	struct simble_central_conn_mgr *mgr = &ctx->conn_mgr;
+
+	segger_rtt_printf("sec: %u bonds\n", ctx->bonds.count);
+	for (int i = 0; i < mgr->peer_count; i++) {
+		struct simble_central_peer *p = &mgr->peers[i];
+		if (p->state == SIMBLE_LINK_UNUSED || p->encrypts == 0) {
+			continue;
+		}
+		segger_rtt_printf("sec: peer %d encrypted %u times, last %u ms avg %u ms max %u ms\n",
+			i, p->encrypts, RTC_TICKS_TO_MS(p->encrypt_last),
+			RTC_TICKS_TO_MS(p->encrypt_total / p->encrypts),
+			RTC_TICKS_TO_MS(p->encrypt_max));
+	}
+}
+
+static void
+dm_evt_cb(ble_evt_t *evt, void *arg)
+{
+	dm_ble_evt_handler(evt);
+}
+
+static void
+conn_mgr_evt_cb(ble_evt_t *evt, void *arg)
+{
+	scan_handle_ble_event(arg, evt);
+	conn_mgr_handle_ble_event(arg, evt);
+}
+
+static void
+conn_mgr_idle_cb(void *arg)
+{
+	struct simble_central_ctx_t *ctx = arg;
+	struct simble_central_scan *scan = &ctx->scan;
+	uint32_t now = rtc_now();
+
+	link_encrypt_expire(ctx, now);
+	if (time_reached(scan->rate_at + RTC_MS_TO_TICKS(SCAN_RATE_PERIOD_MS), now)) {
+		scan->report_rate = (uint32_t)scan->reports * RTC_TICK_FREQ / (now - scan->rate_at);
+		scan->reports = 0;
+		scan->rate_at = now;
+		/* separate thresholds, a rate near one does not flap the mode */
+		if (scan->report_rate > SCAN_PASSIVE_ENTER_RATE) {
+			scan->passive = true;
+		} else if (scan->report_rate < SCAN_PASSIVE_LEAVE_RATE) {
+			scan->passive = false;
+		}
+		/* re-plan with the new rate and backoffs that ran out */
+		scan->pending |= scan->running && scan_managed(ctx);
+	}
+	if (scan->pending) {
+		scan_update(ctx);
+	}
+}
+
+static void
+app_evt_cb(ble_evt_t *evt, void *arg)
+{
+	struct simble_central_ctx_t *ctx = arg;
+
+	if (ctx->ble_event_handler_cb) {
+		ctx->ble_event_handler_cb(ctx, evt);
+	}
+}
+
+static void
+pstorage_evt_cb(uint32_t evt_id, void *arg)
+{
+	pstorage_sys_event_handler(evt_id);
+}
+
 void
 simble_central_process_event_loop(struct simble_central_ctx_t *ctx)
 {
-	uint32_t err_code, evt_id;
-	uint32_t ble_evt_buffer[CEIL_DIV(BLE_EVT_BUF_SIZE, sizeof(uint32_t))];
-	uint16_t ble_evt_buffer_len = sizeof(ble_evt_buffer);
+	uint32_t err_code;
 	for (;;) {
 		if (ctx->before_wait_cb) {
 			ctx->before_wait_cb(ctx);
 		}
-		while (sd_evt_get(&evt_id) == NRF_SUCCESS) {
-			pstorage_sys_event_handler(evt_id);
-		}
-		while (sd_ble_evt_get((uint8_t*)&ble_evt_buffer, &ble_evt_buffer_len) == NRF_SUCCESS) {
-			dm_ble_evt_handler((ble_evt_t*)&ble_evt_buffer);
-			if (ctx->ble_event_handler_cb) {
-				ctx->ble_event_handler_cb(ctx, (ble_evt_t*)&ble_evt_buffer);
-			}
-			ble_evt_buffer_len = sizeof(ble_evt_buffer);
-		}
-		err_code = sd_app_evt_wait();
+		simble_evt_process();
+		err_code = simble_evt_wait();
 		APP_ERROR_CHECK(err_code);
 	}
 }
@@ -87,6 +865,10 @@ void
 simble_central_init(const char *name, struct simble_central_ctx_t *ctx)
 {
 	global_ctx = ctx;
+	ctx->conn_mgr.connecting = -1;
+	for (int i = 0; i < SIMBLE_CENTRAL_MAX_LINKS; i++) {
+		ctx->links[i].conn_handle = BLE_CONN_HANDLE_INVALID;
+	}
 	// softdevice init
 	uint32_t err_code = sd_softdevice_enable(NRF_CLOCK_LFCLKSRC_XTAL_20_PPM, softdevice_assertion_handler);
 	APP_ERROR_CHECK(err_code);
@@ -123,16 +905,49 @@ simble_central_init(const char *name, struct simble_central_ctx_t *ctx)
 	app_param.sec_param.max_key_size = 16;
 	err_code = dm_register(&ctx->app_id, &app_param);
 	APP_ERROR_CHECK(err_code);
+	bond_index_load(ctx);
+	// event dispatch
+	simble_soc_evt_register(&pstorage_handler, pstorage_evt_cb, NULL);
+	simble_evt_register(&dm_handler, SIMBLE_EVT_RANGE_ALL, dm_evt_cb, NULL);
+	simble_evt_register(&conn_mgr_handler, SIMBLE_EVT_RANGE_GAP, conn_mgr_evt_cb, ctx);
+	simble_evt_register(&app_handler, SIMBLE_EVT_RANGE_ALL, app_evt_cb, ctx);
+	simble_idle_register(&conn_mgr_idle, conn_mgr_idle_cb, ctx);
 }
 
 bool
 simble_central_scan_start(struct simble_central_ctx_t *ctx)
 {
-	uint32_t err_code = sd_ble_gap_scan_start(&ctx->scan_params);
-	// NRF_ERROR_BUSY The stack is busy, process pending events and retry.
-	if (err_code == NRF_ERROR_BUSY) {
-		return false;
+	scan_update(ctx);
+	/* a plan of SIMBLE_SCAN_OFF, or a busy stack, leaves it stopped */
+	return ctx->scan.running;
+}
+
+void
+simble_central_scan_report(struct simble_central_ctx_t *ctx)
+{
+	struct simble_central_scan *scan = &ctx->scan;
+	uint32_t now = rtc_now();
+	uint32_t span = now - scan->stats_since;
+
+	/* account the running scan up to now */
+	if (scan->running) {
+		scan_stopped(scan, now);
+		scan->running = true;
+		scan->started_at = now;
+	}
+	segger_rtt_printf("scan: mode %u, window %u interval %u %s, %u reports/s\n",
+		scan->mode, scan->params.window, scan->params.interval,
+		scan->params.active ? "active" : "passive", scan->report_rate);
+	if (span > 0) {
+		segger_rtt_printf("scan: enabled %u%% listening %u%% of %u s, %u busy\n",
+			(uint32_t)((uint64_t)scan->on_time * 100 / span),
+			(uint32_t)((uint64_t)scan->duty_time * 100 / span),
+			RTC_TICKS_TO_MS(span) / 1000, scan->busy);
+	}
+	if (scan->discoveries > 0) {
+		segger_rtt_printf("scan: %u discoveries, last %u ms avg %u ms max %u ms\n",
+			scan->discoveries, RTC_TICKS_TO_MS(scan->discover_last),
+			RTC_TICKS_TO_MS(scan->discover_total / scan->discoveries),
+			RTC_TICKS_TO_MS(scan->discover_max));
 	}
-	APP_ERROR_CHECK(err_code);
-	return true;
 }
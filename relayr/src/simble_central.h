@@ -3,7 +3,115 @@
 #include <ble.h>
 #include <device_manager.h>
 
+/* Connection manager: keeps the registered peers connected, up to the
+   number of links the S120 can hold. */
+#define SIMBLE_CENTRAL_MAX_LINKS	8
+#define SIMBLE_CENTRAL_MAX_PEERS	16
+
+enum simble_central_link_state {
+	SIMBLE_LINK_UNUSED = 0,
+	SIMBLE_LINK_IDLE,	/* disconnected, connect on next ADV report */
+	SIMBLE_LINK_BACKOFF,	/* disconnected, waiting for retry_at */
+	SIMBLE_LINK_CONNECTING,
+	SIMBLE_LINK_CONNECTED,
+	SIMBLE_LINK_REMOVING,	/* removed while connected, slot freed on disconnect */
+};
+
+struct simble_central_peer {
+	ble_gap_addr_t addr;
+	uint8_t state;
+	uint8_t failures;	/* consecutive, drives the backoff */
+	uint8_t last_reason;	/* HCI reason of the last disconnect */
+	uint16_t conn_handle;
+	uint16_t connects;
+	uint32_t retry_at;	/* RTC ticks */
+	uint32_t connected_at;
+	uint32_t uptime;	/* accumulated over finished links */
+	uint16_t encrypts;	/* re-encrypted links */
+	uint32_t encrypt_last;	/* ticks from connect to encrypted link */
+	uint32_t encrypt_max;
+	uint32_t encrypt_total;
+	bool seen;		/* ADV report since missing_since */
+	uint32_t missing_since;	/* RTC ticks, disconnect or peer_add */
+};
+
+struct simble_central_conn_mgr {
+	struct simble_central_peer peers[SIMBLE_CENTRAL_MAX_PEERS];
+	uint8_t peer_count;
+	int8_t connecting;	/* peer index, -1 if none */
+	uint32_t holdoff_until;	/* no connect before this, lets scanning run */
+	bool started;		/* simble_central_conn_mgr_start() called */
+};
+
+/* Security: peers bonded earlier are re-encrypted with the stored LTK
+   right on connect and the link is reported ready to GATT users only
+   once encrypted, or unencrypted after a few seconds without an outcome;
+   links to unknown peers are ready at once.  The bond
+   index mirrors the device manager's bonded peers in RAM. */
+#define SIMBLE_CENTRAL_MAX_BONDS	DEVICE_MANAGER_MAX_BONDS
+
+enum simble_central_sec_state {
+	SIMBLE_SEC_OPEN = 0,	/* unknown peer, or encryption failed */
+	SIMBLE_SEC_ENCRYPTING,
+	SIMBLE_SEC_ENCRYPTED,
+};
+
+struct simble_central_link {
+	uint16_t conn_handle;
+	uint8_t role;		/* BLE_GAP_ROLE_*, only central links count */
+	uint8_t sec_state;
+	bool ready;
+	dm_handle_t dm_handle;
+	ble_gap_addr_t addr;
+	uint32_t connected_at;
+	const void *gattc_owner;	/* see simble_central_gattc_claim() */
+};
+
+struct simble_central_bonds {
+	ble_gap_addr_t addr[SIMBLE_CENTRAL_MAX_BONDS];
+	uint8_t device_id[SIMBLE_CENTRAL_MAX_BONDS];
+	uint8_t count;
+};
+
+/* Scan scheduler: ctx->scan_params give the full duty profile used
+   while hunting for missing peers.  Once the hunt has gone on for a
+   while, or when every missing peer is in backoff, the window drops to
+   a background duty; it also shrinks by the airtime the connection
+   events take, and a crowded channel (high ADV report rate) switches
+   to passive scanning until the rate has dropped well below that.
+   Without registered peers, and before simble_central_conn_mgr_start(),
+   scanning is left to the application: it runs the fixed profile and
+   is not restarted after its timeout. */
+enum simble_central_scan_mode {
+	SIMBLE_SCAN_OFF = 0,
+	SIMBLE_SCAN_HUNT,
+	SIMBLE_SCAN_BACKGROUND,
+};
+
+struct simble_central_scan {
+	uint8_t mode;
+	bool running;
+	bool pending;		/* start refused or re-plan due, on next idle */
+	bool passive;		/* crowded channel, no scan requests */
+	ble_gap_scan_params_t params;	/* in use while running */
+	uint32_t started_at;
+	uint32_t hunt_since;	/* a peer went missing */
+	uint32_t rate_at;
+	uint16_t reports;	/* ADV reports since rate_at */
+	uint16_t report_rate;	/* per second */
+	/* statistics */
+	uint32_t stats_since;
+	uint32_t on_time;	/* ticks with scanning enabled */
+	uint32_t duty_time;	/* ticks listening, on_time * window / interval */
+	uint16_t busy;		/* starts refused with NRF_ERROR_BUSY */
+	uint16_t discoveries;	/* missing peers seen again */
+	uint32_t discover_last;	/* ticks from missing to first ADV report */
+	uint32_t discover_max;
+	uint32_t discover_total;
+};
+
 struct simble_central_ctx_t;
+struct simble_central_aggr;
 
 typedef void (device_connect_cb_t) (dm_handle_t const *p_handle,
 	dm_event_t const *p_event);
@@ -11,6 +119,7 @@ typedef void (device_disconnect_cb_t) (dm_handle_t const *p_handle,
 	dm_event_t const *p_event);
 typedef void (ble_event_handler_cb) (struct simble_central_ctx_t *ctx, ble_evt_t *evt);
 typedef void (before_wait_cb_t) (struct simble_central_ctx_t *ctx);
+typedef void (link_ready_cb_t) (struct simble_central_ctx_t *ctx, uint16_t conn_handle);
 
 struct simble_central_ctx_t {
 	char *name;
@@ -21,9 +130,38 @@ struct simble_central_ctx_t {
 	device_disconnect_cb_t *disconnect_cb;
 	ble_event_handler_cb *ble_event_handler_cb;
 	before_wait_cb_t *before_wait_cb;
+	link_ready_cb_t *link_ready_cb;	/* GATT may be used from here on */
 	dm_application_instance_t app_id;
+	struct simble_central_conn_mgr conn_mgr;
+	struct simble_central_aggr *aggr;	/* optional, simble_central_aggr_init() */
+	struct simble_central_link links[SIMBLE_CENTRAL_MAX_LINKS];
+	struct simble_central_bonds bonds;
+	struct simble_central_scan scan;
 };
 
 void simble_central_init(const char *name, struct simble_central_ctx_t *ctx);
 void simble_central_process_event_loop(struct simble_central_ctx_t *ctx) __attribute__ ((noreturn));
+/* true if scanning; false if the SoftDevice was busy, the start is
+   then retried when idle, or if the plan is SIMBLE_SCAN_OFF (no peer
+   left to look for) */
 bool simble_central_scan_start(struct simble_central_ctx_t *ctx);
+void simble_central_scan_report(struct simble_central_ctx_t *ctx);
+
+/* The connection manager uses rtc_now() as time base, rtc_init() must
+   have been called. */
+int simble_central_peer_add(struct simble_central_ctx_t *ctx, const ble_gap_addr_t *addr);
+void simble_central_peer_remove(struct simble_central_ctx_t *ctx, int idx);
+struct simble_central_peer *simble_central_peer_find(struct simble_central_ctx_t *ctx, uint16_t conn_handle);
+uint32_t simble_central_peer_uptime(struct simble_central_ctx_t *ctx, int idx);
+void simble_central_conn_mgr_start(struct simble_central_ctx_t *ctx);
+
+bool simble_central_link_ready(struct simble_central_ctx_t *ctx, uint16_t conn_handle);
+
+/* GATT client responses only carry the conn_handle, so one user at a
+   time runs discovery and requests on a link.  A claim fails while
+   another owner holds the link; disconnect releases it. */
+bool simble_central_gattc_claim(struct simble_central_ctx_t *ctx, uint16_t conn_handle, const void *owner);
+void simble_central_gattc_release(struct simble_central_ctx_t *ctx, uint16_t conn_handle, const void *owner);
+bool simble_central_gattc_owned(struct simble_central_ctx_t *ctx, uint16_t conn_handle, const void *owner);
+bool simble_central_bonded(struct simble_central_ctx_t *ctx, const ble_gap_addr_t *addr);
+void simble_central_sec_report(struct simble_central_ctx_t *ctx);
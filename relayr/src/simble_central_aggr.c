@@ -0,0 +1,395 @@
+#include "simble_central_aggr.h"
+#include <app_error.h>
+#include <app_util.h>
+#include <string.h>
+
+#include "rtc.h"
+#include "simble_evt.h"
+
+enum aggr_link_state {
+	AGGR_LINK_FREE = 0,
+	AGGR_LINK_WAIT,		/* GATT client busy with another user */
+	AGGR_LINK_CHAR_DISC,
+	AGGR_LINK_DESC_DISC,
+	AGGR_LINK_CCCD_WRITE,
+	AGGR_LINK_READY,
+};
+
+static struct simble_central_aggr *aggr_ctx;
+static struct simble_central_ctx_t *aggr_central;
+static struct simble_evt_handler aggr_gap_handler, aggr_gattc_handler;
+static struct simble_idle_handler aggr_idle;
+
+static struct simble_aggr_link *
+aggr_link_find(struct simble_central_aggr *aggr, uint16_t conn_handle)
+{
+	for (int i = 0; i < SIMBLE_CENTRAL_MAX_LINKS; i++) {
+		struct simble_aggr_link *l = &aggr->links[i];
+		if (l->state != AGGR_LINK_FREE && l->conn_handle == conn_handle) {
+			return l;
+		}
+	}
+	return NULL;
+}
+
+static struct simble_aggr_link *
+aggr_link_alloc(struct simble_central_aggr *aggr)
+{
+	for (int i = 0; i < SIMBLE_CENTRAL_MAX_LINKS; i++) {
+		if (aggr->links[i].state == AGGR_LINK_FREE) {
+			return &aggr->links[i];
+		}
+	}
+	return NULL;
+}
+
+static int
+aggr_char_index(struct simble_central_aggr *aggr, const ble_uuid_t *uuid)
+{
+	for (int i = 0; i < aggr->uuid_count; i++) {
+		if (aggr->uuids[i].type == uuid->type && aggr->uuids[i].uuid == uuid->uuid) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void
+aggr_deadline_cb(struct rtc_ctx *ctx)
+{
+	/* only wakes the event loop, which does the flush */
+	aggr_ctx->timer_armed = false;
+}
+
+static void
+aggr_arm_deadline(struct simble_central_aggr *aggr, uint32_t ticks)
+{
+	/* without a free timer the deadline is checked on the next event */
+	if (!aggr->timer_armed && rtc_oneshot_timer(ticks ? ticks : 1, aggr_deadline_cb)) {
+		aggr->timer_armed = true;
+	}
+}
+
+void
+simble_central_aggr_flush(struct simble_central_aggr *aggr)
+{
+	if (aggr->len > SIMBLE_AGGR_HDR_SIZE) {
+		aggr->sink((const uint8_t *)aggr->buf, aggr->len);
+		aggr->flushes++;
+	}
+	aggr->len = 0;
+}
+
+static void
+aggr_append(struct simble_central_ctx_t *ctx, struct simble_central_aggr *aggr,
+	struct simble_aggr_link *l, int ci, const uint8_t *data, uint16_t len)
+{
+	uint8_t *buf = (uint8_t *)aggr->buf;
+	uint32_t now = rtc_now();
+	uint16_t rec_len = SIMBLE_AGGR_REC_SIZE + len;
+	struct simble_central_peer *p = simble_central_peer_find(ctx, l->conn_handle);
+
+	/* peer removed from the connection manager, no ID left */
+	if (p == NULL || SIMBLE_AGGR_HDR_SIZE + rec_len > aggr->flush_size) {
+		aggr->dropped++;
+		return;
+	}
+	/* flush first if the record does not fit or dt would overflow */
+	if (aggr->len != 0 &&
+	    (aggr->len + rec_len > aggr->flush_size || now - aggr->base > UINT16_MAX)) {
+		simble_central_aggr_flush(aggr);
+	}
+	if (aggr->len == 0) {
+		aggr->base = now;
+		aggr->len = uint32_encode(now, buf);
+		aggr_arm_deadline(aggr, RTC_MS_TO_TICKS(aggr->flush_ms));
+	}
+
+	buf[aggr->len++] = ((p - ctx->conn_mgr.peers) << 4) | ci;
+	aggr->len += uint16_encode(now - aggr->base, &buf[aggr->len]);
+	buf[aggr->len++] = len;
+	memcpy(&buf[aggr->len], data, len);
+	aggr->len += len;
+	aggr->records++;
+
+	if (aggr->len + SIMBLE_AGGR_REC_SIZE >= aggr->flush_size) {
+		simble_central_aggr_flush(aggr);
+	}
+}
+
+static void
+aggr_link_done(struct simble_aggr_link *l)
+{
+	l->state = AGGR_LINK_READY;
+	simble_central_gattc_release(aggr_central, l->conn_handle, aggr_ctx);
+}
+
+static void
+aggr_discover_chars(struct simble_aggr_link *l, uint16_t start)
+{
+	ble_gattc_handle_range_t range = {
+		.start_handle = start,
+		.end_handle = 0xffff,
+	};
+	l->state = AGGR_LINK_CHAR_DISC;
+	if (sd_ble_gattc_characteristics_discover(l->conn_handle, &range) != NRF_SUCCESS) {
+		aggr_link_done(l);
+	}
+}
+
+/* walk to the next discovered characteristic and look up its CCCD */
+static void
+aggr_subscribe_next(struct simble_central_aggr *aggr, struct simble_aggr_link *l)
+{
+	for (; l->cur < aggr->uuid_count; l->cur++) {
+		if (l->value_handle[l->cur] == 0) {
+			continue;
+		}
+		ble_gattc_handle_range_t range = {
+			.start_handle = l->value_handle[l->cur] + 1,
+			.end_handle = 0xffff,
+		};
+		l->state = AGGR_LINK_DESC_DISC;
+		if (sd_ble_gattc_descriptors_discover(l->conn_handle, &range) == NRF_SUCCESS) {
+			return;
+		}
+	}
+	aggr_link_done(l);
+}
+
+static void
+aggr_write_cccd(struct simble_central_aggr *aggr, struct simble_aggr_link *l)
+{
+	/* must stay valid until the write is sent */
+	static const uint8_t cccd_notify[2] = {1, 0};
+	static const uint8_t cccd_indicate[2] = {2, 0};
+
+	ble_gattc_write_params_t write_params = {
+		.write_op = BLE_GATT_OP_WRITE_REQ,
+		.handle = l->cccd_handle[l->cur],
+		.offset = 0,
+		.len = sizeof(cccd_notify),
+		.p_value = (l->indicate_mask & (1 << l->cur)) ? cccd_indicate : cccd_notify,
+	};
+	l->state = AGGR_LINK_CCCD_WRITE;
+	if (sd_ble_gattc_write(l->conn_handle, &write_params) != NRF_SUCCESS) {
+		l->cur++;
+		aggr_subscribe_next(aggr, l);
+	}
+}
+
+static void
+aggr_char_disc_rsp(struct simble_central_aggr *aggr, struct simble_aggr_link *l,
+	const ble_gattc_evt_t *gattc_evt)
+{
+	if (gattc_evt->gatt_status != BLE_GATT_STATUS_SUCCESS) {
+		/* ATTRIBUTE_NOT_FOUND: end of the attribute table */
+		l->cur = 0;
+		aggr_subscribe_next(aggr, l);
+		return;
+	}
+
+	uint16_t last = 0;
+	for (int i = 0; i < gattc_evt->params.char_disc_rsp.count; i++) {
+		const ble_gattc_char_t *chr = &gattc_evt->params.char_disc_rsp.chars[i];
+		int ci = aggr_char_index(aggr, &chr->uuid);
+		if (ci >= 0 && (chr->char_props.notify || chr->char_props.indicate)) {
+			l->value_handle[ci] = chr->handle_value;
+			if (!chr->char_props.notify) {
+				l->indicate_mask |= 1 << ci;
+			}
+		}
+		last = chr->handle_value;
+	}
+	if (last == 0 || last == 0xffff) {
+		l->cur = 0;
+		aggr_subscribe_next(aggr, l);
+	} else {
+		aggr_discover_chars(l, last + 1);
+	}
+}
+
+static void
+aggr_desc_disc_rsp(struct simble_central_aggr *aggr, struct simble_aggr_link *l,
+	const ble_gattc_evt_t *gattc_evt)
+{
+	if (gattc_evt->gatt_status == BLE_GATT_STATUS_SUCCESS) {
+		for (int i = 0; i < gattc_evt->params.desc_disc_rsp.count; i++) {
+			const ble_gattc_desc_t *desc = &gattc_evt->params.desc_disc_rsp.descs[i];
+			if (desc->uuid.type != BLE_UUID_TYPE_BLE) {
+				continue;
+			}
+			if (desc->uuid.uuid == BLE_UUID_DESCRIPTOR_CLIENT_CHAR_CONFIG) {
+				l->cccd_handle[l->cur] = desc->handle;
+				aggr_write_cccd(aggr, l);
+				return;
+			}
+			/* reached the next characteristic or service */
+			if (desc->uuid.uuid == BLE_UUID_CHARACTERISTIC ||
+			    desc->uuid.uuid == BLE_UUID_SERVICE_PRIMARY ||
+			    desc->uuid.uuid == BLE_UUID_SERVICE_SECONDARY) {
+				break;
+			}
+		}
+	}
+	l->cur++;
+	aggr_subscribe_next(aggr, l);
+}
+
+static void
+aggr_hvx(struct simble_central_ctx_t *ctx, struct simble_central_aggr *aggr,
+	struct simble_aggr_link *l, const ble_gattc_evt_t *gattc_evt)
+{
+	uint16_t handle = gattc_evt->params.hvx.handle;
+
+	if (gattc_evt->params.hvx.type == BLE_GATT_HVX_INDICATION) {
+		sd_ble_gattc_hv_confirm(l->conn_handle, handle);
+	}
+	for (int ci = 0; ci < aggr->uuid_count; ci++) {
+		if (l->value_handle[ci] == handle) {
+			aggr_append(ctx, aggr, l, ci, gattc_evt->params.hvx.data,
+				gattc_evt->params.hvx.len);
+			return;
+		}
+	}
+}
+
+/* called by simble_central once the link may carry GATT traffic */
+void
+simble_central_aggr_link_ready(struct simble_central_ctx_t *ctx, uint16_t conn_handle)
+{
+	struct simble_aggr_link *l;
+
+	/* records identify peers by their connection manager index */
+	if (simble_central_peer_find(ctx, conn_handle) == NULL) {
+		return;
+	}
+	l = aggr_link_alloc(ctx->aggr);
+	if (l == NULL) {
+		return;
+	}
+	*l = (struct simble_aggr_link){
+		.conn_handle = conn_handle,
+		.state = AGGR_LINK_WAIT,
+	};
+	if (simble_central_gattc_claim(ctx, conn_handle, ctx->aggr)) {
+		aggr_discover_chars(l, 1);
+	}
+}
+
+/* links that found the GATT client busy retry once it is released */
+static void
+aggr_claim_waiting(struct simble_central_ctx_t *ctx, struct simble_central_aggr *aggr)
+{
+	for (int i = 0; i < SIMBLE_CENTRAL_MAX_LINKS; i++) {
+		struct simble_aggr_link *l = &aggr->links[i];
+		if (l->state == AGGR_LINK_WAIT &&
+		    simble_central_gattc_claim(ctx, l->conn_handle, aggr)) {
+			aggr_discover_chars(l, 1);
+		}
+	}
+}
+
+void
+simble_central_aggr_handle_ble_event(struct simble_central_ctx_t *ctx, ble_evt_t *evt)
+{
+	struct simble_central_aggr *aggr = ctx->aggr;
+	const ble_gattc_evt_t *gattc_evt = &evt->evt.gattc_evt;
+	struct simble_aggr_link *l;
+
+	switch (evt->header.evt_id) {
+	case BLE_GAP_EVT_DISCONNECTED:
+		l = aggr_link_find(aggr, evt->evt.gap_evt.conn_handle);
+		if (l != NULL) {
+			l->state = AGGR_LINK_FREE;
+			l->conn_handle = BLE_CONN_HANDLE_INVALID;
+		}
+		break;
+	case BLE_GATTC_EVT_CHAR_DISC_RSP:
+		l = aggr_link_find(aggr, gattc_evt->conn_handle);
+		if (l != NULL && l->state == AGGR_LINK_CHAR_DISC &&
+		    simble_central_gattc_owned(ctx, l->conn_handle, aggr)) {
+			aggr_char_disc_rsp(aggr, l, gattc_evt);
+		}
+		break;
+	case BLE_GATTC_EVT_DESC_DISC_RSP:
+		l = aggr_link_find(aggr, gattc_evt->conn_handle);
+		if (l != NULL && l->state == AGGR_LINK_DESC_DISC &&
+		    simble_central_gattc_owned(ctx, l->conn_handle, aggr)) {
+			aggr_desc_disc_rsp(aggr, l, gattc_evt);
+		}
+		break;
+	case BLE_GATTC_EVT_WRITE_RSP:
+		l = aggr_link_find(aggr, gattc_evt->conn_handle);
+		if (l != NULL && l->state == AGGR_LINK_CCCD_WRITE &&
+		    simble_central_gattc_owned(ctx, l->conn_handle, aggr)) {
+			l->cur++;
+			aggr_subscribe_next(aggr, l);
+		}
+		break;
+	case BLE_GATTC_EVT_HVX:
+		l = aggr_link_find(aggr, gattc_evt->conn_handle);
+		if (l != NULL) {
+			aggr_hvx(ctx, aggr, l, gattc_evt);
+		}
+		break;
+	}
+}
+
+static void
+aggr_evt_cb(ble_evt_t *evt, void *arg)
+{
+	simble_central_aggr_handle_ble_event(arg, evt);
+}
+
+static void
+aggr_idle_cb(void *arg)
+{
+	struct simble_central_ctx_t *ctx = arg;
+
+	aggr_claim_waiting(ctx, ctx->aggr);
+	simble_central_aggr_poll(ctx);
+}
+
+void
+simble_central_aggr_poll(struct simble_central_ctx_t *ctx)
+{
+	struct simble_central_aggr *aggr = ctx->aggr;
+	uint32_t deadline = RTC_MS_TO_TICKS(aggr->flush_ms);
+	uint32_t elapsed;
+
+	if (aggr->len == 0) {
+		return;
+	}
+	elapsed = rtc_now() - aggr->base;
+	if (elapsed >= deadline) {
+		simble_central_aggr_flush(aggr);
+	} else {
+		/* woken by a stale timer of an earlier batch */
+		aggr_arm_deadline(aggr, deadline - elapsed);
+	}
+}
+
+void
+simble_central_aggr_init(struct simble_central_ctx_t *ctx, struct simble_central_aggr *aggr)
+{
+	aggr_ctx = aggr;
+	aggr_central = ctx;
+	ctx->aggr = aggr;
+	if (aggr->flush_size == 0 || aggr->flush_size > SIMBLE_AGGR_BUF_SIZE) {
+		aggr->flush_size = SIMBLE_AGGR_BUF_SIZE;
+	}
+	if (aggr->uuid_count > SIMBLE_AGGR_MAX_CHARS) {
+		aggr->uuid_count = SIMBLE_AGGR_MAX_CHARS;
+	}
+	for (int i = 0; i < SIMBLE_CENTRAL_MAX_LINKS; i++) {
+		aggr->links[i].state = AGGR_LINK_FREE;
+		aggr->links[i].conn_handle = BLE_CONN_HANDLE_INVALID;
+	}
+	aggr->len = 0;
+	aggr->timer_armed = false;
+
+	simble_evt_register(&aggr_gap_handler, SIMBLE_EVT_RANGE_GAP, aggr_evt_cb, ctx);
+	simble_evt_register(&aggr_gattc_handler, SIMBLE_EVT_RANGE_GATTC, aggr_evt_cb, ctx);
+	simble_idle_register(&aggr_idle, aggr_idle_cb, ctx);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <ble.h>
+
+#include "simble_central.h"
+
+/* Notification aggregator: subscribes to the configured characteristics
+   on every connected peer and packs the HVX payloads into one batch.
+   Only peers registered with the connection manager are aggregated,
+   their index identifies them in the records.
+
+   Batch layout (little endian):
+	uint32_t base;		rtc_now() of the first record
+	records[]:
+	uint8_t id;		conn_mgr peer index << 4 | characteristic index
+	uint16_t dt;		ticks since base
+	uint8_t len;
+	uint8_t data[len];
+*/
+
+#define SIMBLE_AGGR_MAX_CHARS	4
+#define SIMBLE_AGGR_BUF_SIZE	244
+#define SIMBLE_AGGR_HDR_SIZE	4
+#define SIMBLE_AGGR_REC_SIZE	4
+
+typedef void (simble_aggr_sink_t) (const uint8_t *buf, uint16_t len);
+
+struct simble_aggr_link {
+	uint16_t conn_handle;
+	uint8_t state;
+	uint8_t cur;		/* characteristic being discovered/subscribed */
+	uint16_t value_handle[SIMBLE_AGGR_MAX_CHARS];
+	uint16_t cccd_handle[SIMBLE_AGGR_MAX_CHARS];
+	uint8_t indicate_mask;	/* chars that only support indications */
+};
+
+struct simble_central_aggr {
+	/* configuration, set by the application */
+	const ble_uuid_t *uuids;
+	uint8_t uuid_count;
+	uint16_t flush_size;	/* flush when the batch would exceed this */
+	uint32_t flush_ms;	/* flush at most this long after the first record,
+				   0 flushes once per event loop iteration */
+	simble_aggr_sink_t *sink;
+
+	/* statistics */
+	uint32_t records;
+	uint32_t dropped;
+	uint32_t flushes;
+
+	struct simble_aggr_link links[SIMBLE_CENTRAL_MAX_LINKS];
+	volatile bool timer_armed;
+	uint16_t len;
+	uint32_t base;
+	uint32_t buf[CEIL_DIV(SIMBLE_AGGR_BUF_SIZE, sizeof(uint32_t))];
+};
+
+void simble_central_aggr_init(struct simble_central_ctx_t *ctx, struct simble_central_aggr *aggr);
+void simble_central_aggr_link_ready(struct simble_central_ctx_t *ctx, uint16_t conn_handle);
+void simble_central_aggr_handle_ble_event(struct simble_central_ctx_t *ctx, ble_evt_t *evt);
+void simble_central_aggr_poll(struct simble_central_ctx_t *ctx);
+void simble_central_aggr_flush(struct simble_central_aggr *aggr);
@@ -0,0 +1,467 @@
+#include "simble_central_bench.h"
+#include <string.h>
+
+#include "simble.h"
+#include "simble_evt.h"
+#include "rtc.h"
+#include "gatt_codec.h"
+#include "segger_rtt_init.h"
+
+enum bench_state {
+	BENCH_IDLE = 0,
+	BENCH_CHAR_DISC,
+	BENCH_DESC_DISC,
+	BENCH_CCCD_WRITE,
+	BENCH_CTRL_WRITE,
+	BENCH_RUN,
+	BENCH_STATS_READ,
+};
+
+#define BENCH_HDR_LEN	8	/* sequence number, send time */
+
+static struct simble_central_bench *bench_ctx;
+static struct simble_evt_handler bench_handler;
+static struct simble_idle_handler bench_idle;
+
+static void bench_finish(struct simble_central_bench *b);
+
+static void
+bench_stop(struct simble_central_bench *b)
+{
+	b->state = BENCH_IDLE;
+	simble_central_gattc_release(b->ctx, b->conn_handle, b);
+}
+
+static void
+bench_timeout_cb(struct rtc_ctx *ctx)
+{
+	/* only wakes the event loop, which checks the deadline */
+	bench_ctx->timer_armed = false;
+}
+
+static void
+bench_arm_timeout(struct simble_central_bench *b, uint32_t ticks)
+{
+	if (!b->timer_armed && rtc_oneshot_timer(ticks ? ticks : 1, bench_timeout_cb)) {
+		b->timer_armed = true;
+	}
+}
+
+static void
+bench_account(struct simble_central_bench *b, uint16_t packets, uint16_t len)
+{
+	b->packets += packets;
+	b->bytes += (uint32_t)packets * len;
+	b->ticks = rtc_now() - b->start;
+}
+
+static uint32_t
+bench_write(struct simble_central_bench *b, uint8_t op, uint16_t handle,
+	const uint8_t *data, uint16_t len)
+{
+	ble_gattc_write_params_t write_params = {
+		.write_op = op,
+		.handle = handle,
+		.offset = 0,
+		.len = len,
+		.p_value = (uint8_t *)data,
+	};
+	return sd_ble_gattc_write(b->conn_handle, &write_params);
+}
+
+static void
+bench_discover_chars(struct simble_central_bench *b, uint16_t start)
+{
+	ble_gattc_handle_range_t range = {
+		.start_handle = start,
+		.end_handle = 0xffff,
+	};
+	b->state = BENCH_CHAR_DISC;
+	if (sd_ble_gattc_characteristics_discover(b->conn_handle, &range) != NRF_SUCCESS) {
+		bench_stop(b);
+	}
+}
+
+static void
+bench_discover_cccd(struct simble_central_bench *b)
+{
+	ble_gattc_handle_range_t range = {
+		.start_handle = b->data_handle + 1,
+		.end_handle = 0xffff,
+	};
+	if (b->ctrl_handle == 0 || b->data_handle == 0 || b->stats_handle == 0) {
+		segger_rtt_printf("bench: service not found\n");
+		bench_stop(b);
+		return;
+	}
+	b->state = BENCH_DESC_DISC;
+	if (sd_ble_gattc_descriptors_discover(b->conn_handle, &range) != NRF_SUCCESS) {
+		bench_stop(b);
+	}
+}
+
+static void
+bench_char_disc_rsp(struct simble_central_bench *b, const ble_gattc_evt_t *gattc_evt)
+{
+	if (gattc_evt->gatt_status != BLE_GATT_STATUS_SUCCESS) {
+		/* ATTRIBUTE_NOT_FOUND: end of the attribute table */
+		bench_discover_cccd(b);
+		return;
+	}
+
+	uint16_t last = 0;
+	for (int i = 0; i < gattc_evt->params.char_disc_rsp.count; i++) {
+		const ble_gattc_char_t *chr = &gattc_evt->params.char_disc_rsp.chars[i];
+		last = chr->handle_value;
+		if (chr->uuid.type != simble_get_vendor_uuid_class()) {
+			continue;
+		}
+		switch (chr->uuid.uuid) {
+		case VENDOR_UUID_BENCH_CTRL_CHAR:
+			b->ctrl_handle = chr->handle_value;
+			break;
+		case VENDOR_UUID_BENCH_DATA_CHAR:
+			b->data_handle = chr->handle_value;
+			break;
+		case VENDOR_UUID_BENCH_STATS_CHAR:
+			b->stats_handle = chr->handle_value;
+			break;
+		}
+	}
+	if (last == 0 || last == 0xffff) {
+		bench_discover_cccd(b);
+	} else {
+		bench_discover_chars(b, last + 1);
+	}
+}
+
+static void
+bench_desc_disc_rsp(struct simble_central_bench *b, const ble_gattc_evt_t *gattc_evt)
+{
+	/* must stay valid until the write is sent */
+	static const uint8_t cccd_notify[2] = {1, 0};
+
+	if (gattc_evt->gatt_status == BLE_GATT_STATUS_SUCCESS) {
+		for (int i = 0; i < gattc_evt->params.desc_disc_rsp.count; i++) {
+			const ble_gattc_desc_t *desc = &gattc_evt->params.desc_disc_rsp.descs[i];
+			if (desc->uuid.type == BLE_UUID_TYPE_BLE &&
+			    desc->uuid.uuid == BLE_UUID_DESCRIPTOR_CLIENT_CHAR_CONFIG) {
+				b->data_cccd = desc->handle;
+				break;
+			}
+		}
+	}
+	if (b->data_cccd == 0) {
+		segger_rtt_printf("bench: no CCCD on data characteristic\n");
+		bench_stop(b);
+		return;
+	}
+	b->state = BENCH_CCCD_WRITE;
+	if (bench_write(b, BLE_GATT_OP_WRITE_REQ, b->data_cccd, cccd_notify, sizeof(cccd_notify)) != NRF_SUCCESS) {
+		bench_stop(b);
+	}
+}
+
+static void
+bench_send_ping(struct simble_central_bench *b)
+{
+	uint8_t *p = gatt_put_le32(b->payload, b->seq);
+	gatt_put_le32(p, rtc_now());
+	if (bench_write(b, BLE_GATT_OP_WRITE_CMD, b->data_handle, b->payload, b->len) != NRF_SUCCESS) {
+		b->errors++;
+		bench_finish(b);
+		return;
+	}
+	b->seq++;
+}
+
+/* fill the TX buffers, resumed on BLE_EVT_TX_COMPLETE */
+static void
+bench_sink_pump(struct simble_central_bench *b)
+{
+	while (b->state == BENCH_RUN && b->seq < b->count) {
+		gatt_put_le32(b->payload, b->seq);
+		uint32_t r = bench_write(b, BLE_GATT_OP_WRITE_CMD, b->data_handle, b->payload, b->len);
+		if (r == BLE_ERROR_NO_TX_BUFFERS) {
+			return;
+		}
+		if (r != NRF_SUCCESS) {
+			b->errors++;
+			bench_finish(b);
+			return;
+		}
+		b->seq++;
+	}
+}
+
+/* packets count once sent on air, the run ends with the last one */
+static void
+bench_sink_sent(struct simble_central_bench *b, uint8_t count)
+{
+	bench_account(b, count, b->len);
+	if (b->packets >= b->count) {
+		bench_finish(b);
+	} else {
+		bench_sink_pump(b);
+	}
+}
+
+static void
+bench_run(struct simble_central_bench *b)
+{
+	b->state = BENCH_RUN;
+	b->start = rtc_now();
+	if (b->timeout_ms != 0) {
+		bench_arm_timeout(b, RTC_MS_TO_TICKS(b->timeout_ms));
+	}
+	switch (b->mode) {
+	case BENCH_MODE_ECHO:
+		bench_send_ping(b);
+		break;
+	case BENCH_MODE_SINK:
+		bench_sink_pump(b);
+		break;
+	}
+}
+
+static void
+bench_hvx(struct simble_central_bench *b, const ble_gattc_evt_t *gattc_evt)
+{
+	const uint8_t *data = gattc_evt->params.hvx.data;
+	uint16_t len = gattc_evt->params.hvx.len;
+
+	if (gattc_evt->params.hvx.handle != b->data_handle) {
+		return;
+	}
+	bench_account(b, 1, len);
+	if (b->mode == BENCH_MODE_ECHO && len >= BENCH_HDR_LEN) {
+		if (b->samples < SIMBLE_BENCH_MAX_SAMPLES) {
+			uint32_t rtt = rtc_now() - gatt_get_le32(data + 4);
+			b->rtt[b->samples++] = rtt > UINT16_MAX ? UINT16_MAX : rtt;
+		}
+		if (b->seq < b->count) {
+			bench_send_ping(b);
+			return;
+		}
+	}
+	if (b->packets >= b->count) {
+		bench_finish(b);
+	}
+}
+
+static void
+bench_finish(struct simble_central_bench *b)
+{
+	if (b->state != BENCH_RUN) {
+		return;
+	}
+	b->state = BENCH_STATS_READ;
+	if (sd_ble_gattc_read(b->conn_handle, b->stats_handle, 0) != NRF_SUCCESS) {
+		bench_stop(b);
+		if (b->done_cb != NULL) {
+			b->done_cb(b);
+		}
+	}
+}
+
+static void
+bench_stats_rsp(struct simble_central_bench *b, const ble_gattc_evt_t *gattc_evt)
+{
+	const uint8_t *data = gattc_evt->params.read_rsp.data;
+
+	if (gattc_evt->gatt_status == BLE_GATT_STATUS_SUCCESS &&
+	    gattc_evt->params.read_rsp.len >= sizeof(struct bench_stats)) {
+		b->peer.bytes = gatt_get_le32(data);
+		b->peer.packets = gatt_get_le32(data + 4);
+		b->peer.errors = gatt_get_le32(data + 8);
+		b->peer.ticks = gatt_get_le32(data + 12);
+	}
+	bench_stop(b);
+	if (b->done_cb != NULL) {
+		b->done_cb(b);
+	}
+}
+
+static void
+bench_evt_cb(ble_evt_t *evt, void *arg)
+{
+	struct simble_central_bench *b = arg;
+	const ble_gattc_evt_t *gattc_evt = &evt->evt.gattc_evt;
+
+	if (b->state == BENCH_IDLE) {
+		return;
+	}
+
+	switch (evt->header.evt_id) {
+	case BLE_GAP_EVT_DISCONNECTED:
+		if (evt->evt.gap_evt.conn_handle == b->conn_handle) {
+			bench_stop(b);
+			b->conn_handle = BLE_CONN_HANDLE_INVALID;
+		}
+		return;
+	case BLE_EVT_TX_COMPLETE:
+		if (evt->evt.common_evt.conn_handle == b->conn_handle &&
+		    b->state == BENCH_RUN && b->mode == BENCH_MODE_SINK) {
+			bench_sink_sent(b, evt->evt.common_evt.params.tx_complete.count);
+		}
+		return;
+	}
+
+	if (gattc_evt->conn_handle != b->conn_handle ||
+	    !simble_central_gattc_owned(b->ctx, b->conn_handle, b)) {
+		return;
+	}
+
+	switch (evt->header.evt_id) {
+	case BLE_GATTC_EVT_CHAR_DISC_RSP:
+		if (b->state == BENCH_CHAR_DISC) {
+			bench_char_disc_rsp(b, gattc_evt);
+		}
+		break;
+	case BLE_GATTC_EVT_DESC_DISC_RSP:
+		if (b->state == BENCH_DESC_DISC) {
+			bench_desc_disc_rsp(b, gattc_evt);
+		}
+		break;
+	case BLE_GATTC_EVT_WRITE_RSP:
+		if (b->state == BENCH_CCCD_WRITE) {
+			/* struct bench_ctrl */
+			uint8_t *p = gatt_put_u8(b->ctrl, b->mode);
+			p = gatt_put_u8(p, b->len);
+			gatt_put_le16(p, b->count);
+			b->state = BENCH_CTRL_WRITE;
+			if (bench_write(b, BLE_GATT_OP_WRITE_REQ, b->ctrl_handle, b->ctrl, sizeof(b->ctrl)) != NRF_SUCCESS) {
+				bench_stop(b);
+			}
+		} else if (b->state == BENCH_CTRL_WRITE) {
+			bench_run(b);
+		}
+		break;
+	case BLE_GATTC_EVT_HVX:
+		if (b->state == BENCH_RUN) {
+			bench_hvx(b, gattc_evt);
+		}
+		break;
+	case BLE_GATTC_EVT_READ_RSP:
+		if (b->state == BENCH_STATS_READ) {
+			bench_stats_rsp(b, gattc_evt);
+		}
+		break;
+	}
+}
+
+static void
+bench_idle_cb(void *arg)
+{
+	struct simble_central_bench *b = arg;
+	uint32_t deadline = RTC_MS_TO_TICKS(b->timeout_ms);
+	uint32_t elapsed;
+
+	if (b->state != BENCH_RUN || b->timeout_ms == 0) {
+		return;
+	}
+	elapsed = rtc_now() - b->start;
+	if (elapsed >= deadline) {
+		b->timed_out = true;
+		bench_finish(b);
+	} else {
+		bench_arm_timeout(b, deadline - elapsed);
+	}
+}
+
+static void
+bench_sort(uint16_t *v, uint16_t n)
+{
+	for (int i = 1; i < n; i++) {
+		uint16_t x = v[i];
+		int j;
+		for (j = i; j > 0 && v[j - 1] > x; j--) {
+			v[j] = v[j - 1];
+		}
+		v[j] = x;
+	}
+}
+
+/* nearest rank, v sorted; 0 without samples */
+static uint32_t
+bench_percentile_ms(const uint16_t *v, uint16_t n, uint8_t pct)
+{
+	if (n == 0) {
+		return 0;
+	}
+	uint16_t rank = (n * pct + 99) / 100;
+	return RTC_TICKS_TO_MS(v[rank > 0 ? rank - 1 : 0]);
+}
+
+void
+simble_central_bench_report(struct simble_central_bench *b)
+{
+	uint32_t ms = RTC_TICKS_TO_MS(b->ticks);
+
+	/* a run stopped (or of count 0) before the first packet */
+	if (b->packets == 0 && b->peer.packets == 0) {
+		segger_rtt_printf("bench: mode %u len %u: no samples, %u errors%s\n",
+			b->mode, b->len, b->errors, b->timed_out ? " (timeout)" : "");
+		return;
+	}
+	segger_rtt_printf("bench: mode %u len %u: %u packets %u bytes in %u ms, %u errors%s\n",
+		b->mode, b->len, b->packets, b->bytes, ms, b->errors,
+		b->timed_out ? " (timeout)" : "");
+	if (ms != 0) {
+		segger_rtt_printf("bench: %u bytes/s %u packets/s\n",
+			(uint32_t)((uint64_t)b->bytes * 1000 / ms),
+			(uint32_t)((uint64_t)b->packets * 1000 / ms));
+	}
+	segger_rtt_printf("bench: peer %u packets %u bytes in %u ms, %u errors\n",
+		b->peer.packets, b->peer.bytes, RTC_TICKS_TO_MS(b->peer.ticks), b->peer.errors);
+	if (b->samples != 0) {
+		bench_sort(b->rtt, b->samples);
+		segger_rtt_printf("bench: rtt ms min %u p50 %u p90 %u p99 %u max %u (%u samples)\n",
+			RTC_TICKS_TO_MS(b->rtt[0]),
+			bench_percentile_ms(b->rtt, b->samples, 50),
+			bench_percentile_ms(b->rtt, b->samples, 90),
+			bench_percentile_ms(b->rtt, b->samples, 99),
+			RTC_TICKS_TO_MS(b->rtt[b->samples - 1]),
+			b->samples);
+	}
+}
+
+bool
+simble_central_bench_start(struct simble_central_bench *b, uint16_t conn_handle)
+{
+	if (b->state != BENCH_IDLE) {
+		return false;
+	}
+	if (b->len < BENCH_HDR_LEN) {
+		b->len = BENCH_HDR_LEN;
+	}
+	if (b->len > BENCH_MAX_PAYLOAD) {
+		b->len = BENCH_MAX_PAYLOAD;
+	}
+	if (!simble_central_gattc_claim(b->ctx, conn_handle, b)) {
+		return false;
+	}
+	memset(b->payload, 0, sizeof(b->payload));
+	b->conn_handle = conn_handle;
+	b->ctrl_handle = b->data_handle = b->data_cccd = b->stats_handle = 0;
+	b->ticks = b->packets = b->bytes = b->errors = 0;
+	b->timed_out = false;
+	b->samples = 0;
+	b->seq = 0;
+	memset(&b->peer, 0, sizeof(b->peer));
+	bench_discover_chars(b, 1);
+	return b->state != BENCH_IDLE;
+}
+
+void
+simble_central_bench_init(struct simble_central_ctx_t *ctx, struct simble_central_bench *b)
+{
+	bench_ctx = b;
+	b->ctx = ctx;
+	b->state = BENCH_IDLE;
+	b->conn_handle = BLE_CONN_HANDLE_INVALID;
+	b->timer_armed = false;
+
+	simble_evt_register(&bench_handler, SIMBLE_EVT_RANGE_ALL, bench_evt_cb, b);
+	simble_idle_register(&bench_idle, bench_idle_cb, b);
+}
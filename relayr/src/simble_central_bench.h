@@ -0,0 +1,62 @@
+#pragma once
+
+#include <ble.h>
+
+#include "simble_central.h"
+#include "bench_serv.h"
+
+/* Drives the benchmark service (bench_serv.h) of a connected peer and
+   reports throughput and latency over RTT.
+
+   echo:  one write command in flight, payload carries the send time,
+	  the round trip is measured on the returned notification
+   flood: counts the peer's notifications
+   sink:  keeps the TX buffers full with write commands, counted as
+	  they are reported sent (BLE_EVT_TX_COMPLETE)
+
+   The peer's own counters are read from the stats characteristic when
+   the run ends. */
+
+#define SIMBLE_BENCH_MAX_SAMPLES	128
+
+struct simble_central_bench;
+
+typedef void (simble_bench_done_cb_t) (struct simble_central_bench *b);
+
+struct simble_central_bench {
+	/* configuration, set by the application */
+	uint8_t mode;		/* enum bench_mode */
+	uint8_t len;		/* payload length, 8..BENCH_MAX_PAYLOAD */
+	uint16_t count;		/* packets per run */
+	uint32_t timeout_ms;	/* 0: no timeout */
+	simble_bench_done_cb_t *done_cb;
+
+	/* results, valid in done_cb */
+	uint32_t ticks;		/* RTC ticks from start to last packet */
+	uint32_t packets;
+	uint32_t bytes;
+	uint32_t errors;
+	bool timed_out;
+	struct bench_stats peer;
+	uint16_t samples;
+	uint16_t rtt[SIMBLE_BENCH_MAX_SAMPLES];	/* RTC ticks */
+
+	struct simble_central_ctx_t *ctx;
+	uint16_t conn_handle;
+	uint8_t state;
+	uint16_t ctrl_handle;
+	uint16_t data_handle;
+	uint16_t data_cccd;
+	uint16_t stats_handle;
+	uint32_t start;
+	uint32_t seq;
+	volatile bool timer_armed;
+	uint8_t ctrl[sizeof(struct bench_ctrl)];
+	uint8_t payload[BENCH_MAX_PAYLOAD];
+};
+
+void simble_central_bench_init(struct simble_central_ctx_t *ctx, struct simble_central_bench *b);
+/* from link_ready_cb, once the link is encrypted where needed; false
+   while another user runs GATT client procedures on the link */
+bool simble_central_bench_start(struct simble_central_bench *b, uint16_t conn_handle);
+void simble_central_bench_report(struct simble_central_bench *b);
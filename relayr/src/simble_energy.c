@@ -0,0 +1,194 @@
+#include <string.h>
+#include <nrf_soc.h>
+#include <app_util.h>
+#include <app_error.h>
+
+#include "simble_energy.h"
+#include "simble_evt.h"
+#include "segger_rtt_init.h"
+#include "rtc.h"
+
+#ifdef SIMBLE_ENERGY
+
+/* the notification precedes the radio event by this distance */
+#define ENERGY_RADIO_DISTANCE   NRF_RADIO_NOTIFICATION_DISTANCE_800US
+#define ENERGY_RADIO_LEAD_US    800
+
+static const uint32_t energy_default_ua[SIMBLE_ENERGY_NUM] = {
+        [SIMBLE_ENERGY_SLEEP] = 3,      /* System ON, RTC running */
+        [SIMBLE_ENERGY_CPU] = 4400,     /* running from flash, 16 MHz */
+        [SIMBLE_ENERGY_ADV] = 11000,    /* mostly TX at 0 dBm */
+        [SIMBLE_ENERGY_CONN] = 12000,   /* TX and RX */
+        [SIMBLE_ENERGY_SENSOR] = 0,     /* board specific */
+        [SIMBLE_ENERGY_ADC] = 260,
+};
+
+static struct {
+        uint32_t current_ua[SIMBLE_ENERGY_NUM];
+        uint32_t ticks[SIMBLE_ENERGY_NUM];
+        uint32_t started[SIMBLE_ENERGY_NUM];
+        uint32_t radio_events[SIMBLE_ENERGY_NUM];
+        uint32_t since;
+        uint8_t links;
+        bool radio_active;
+        uint8_t radio_sub;
+} energy;
+
+static struct simble_evt_handler energy_gap_handler;
+
+void
+simble_energy_begin(enum simble_energy_sub sub)
+{
+        energy.started[sub] = rtc_now();
+}
+
+void
+simble_energy_end(enum simble_energy_sub sub)
+{
+        uint8_t nested;
+
+        sd_nvic_critical_region_enter(&nested);
+        energy.ticks[sub] += rtc_now() - energy.started[sub];
+        sd_nvic_critical_region_exit(nested);
+}
+
+void
+simble_energy_cpu_sleep(void)
+{
+        simble_energy_end(SIMBLE_ENERGY_CPU);
+}
+
+void
+simble_energy_cpu_wake(void)
+{
+        simble_energy_begin(SIMBLE_ENERGY_CPU);
+}
+
+/* radio notification, alternates between before and after a radio event */
+void
+SWI1_IRQHandler(void)
+{
+        energy.radio_active = !energy.radio_active;
+        if (energy.radio_active) {
+                energy.radio_sub = energy.links ? SIMBLE_ENERGY_CONN : SIMBLE_ENERGY_ADV;
+                energy.radio_events[energy.radio_sub]++;
+                simble_energy_begin(energy.radio_sub);
+        } else {
+                energy.ticks[energy.radio_sub] += rtc_now() - energy.started[energy.radio_sub];
+        }
+}
+
+static void
+energy_gap_cb(ble_evt_t *evt, void *arg)
+{
+        switch (evt->header.evt_id) {
+        case BLE_GAP_EVT_CONNECTED:
+                energy.links++;
+                break;
+        case BLE_GAP_EVT_DISCONNECTED:
+                if (energy.links > 0)
+                        energy.links--;
+                break;
+        }
+}
+
+void
+simble_energy_reset(void)
+{
+        uint8_t nested;
+
+        sd_nvic_critical_region_enter(&nested);
+        memset(energy.ticks, 0, sizeof(energy.ticks));
+        memset(energy.radio_events, 0, sizeof(energy.radio_events));
+        energy.since = rtc_now();
+        sd_nvic_critical_region_exit(nested);
+}
+
+void
+simble_energy_init(const uint32_t current_ua[SIMBLE_ENERGY_NUM])
+{
+        memcpy(energy.current_ua, current_ua ? current_ua : energy_default_ua,
+               sizeof(energy.current_ua));
+        energy.radio_active = false;
+        simble_energy_reset();
+        simble_energy_cpu_wake();
+
+        simble_evt_register(&energy_gap_handler, SIMBLE_EVT_RANGE_GAP, energy_gap_cb, NULL);
+
+        sd_nvic_ClearPendingIRQ(SWI1_IRQn);
+        sd_nvic_SetPriority(SWI1_IRQn, NRF_APP_PRIORITY_LOW);
+        sd_nvic_EnableIRQ(SWI1_IRQn);
+        APP_ERROR_CHECK(sd_radio_notification_cfg_set(NRF_RADIO_NOTIFICATION_TYPE_INT_ON_BOTH,
+                                                      ENERGY_RADIO_DISTANCE));
+}
+
+void
+simble_energy_summary(struct simble_energy_summary *sum)
+{
+        uint32_t ticks[SIMBLE_ENERGY_NUM];
+        uint32_t events = 0;
+        uint32_t elapsed;
+        uint8_t nested;
+
+        sd_nvic_critical_region_enter(&nested);
+        memcpy(ticks, energy.ticks, sizeof(ticks));
+        elapsed = rtc_now() - energy.since;
+        for (int i = 0; i < SIMBLE_ENERGY_NUM; i++) {
+                events += energy.radio_events[i];
+                /* the notification lead is not air time; 32 bits of
+                   events times the lead take 64 bits */
+                uint64_t lead = (uint64_t)energy.radio_events[i] * ENERGY_RADIO_LEAD_US *
+                        RTC_TICK_FREQ / 1000000;
+                ticks[i] = ticks[i] > lead ? ticks[i] - lead : 0;
+        }
+        sd_nvic_critical_region_exit(nested);
+
+        ticks[SIMBLE_ENERGY_SLEEP] = elapsed;
+        sum->elapsed_s = RTC_TICKS_TO_MS(elapsed) / 1000;
+        sum->radio_events = events;
+        for (int i = 0; i < SIMBLE_ENERGY_NUM; i++) {
+                uint64_t avg = elapsed ? (uint64_t)energy.current_ua[i] * 10 * ticks[i] / elapsed : 0;
+                sum->avg_current[i] = avg > UINT16_MAX ? UINT16_MAX : avg;
+        }
+}
+
+void
+simble_energy_report(void)
+{
+        static const char *const names[SIMBLE_ENERGY_NUM] = {
+                "sleep", "cpu", "adv", "conn", "sensor", "adc",
+        };
+        struct simble_energy_summary sum;
+        uint32_t total = 0;
+
+        simble_energy_summary(&sum);
+        segger_rtt_printf("energy: %u s, %u radio events\n", sum.elapsed_s, sum.radio_events);
+        for (int i = 0; i < SIMBLE_ENERGY_NUM; i++) {
+                segger_rtt_printf("energy: %s %u.%u uAh/h\n", names[i],
+                                  sum.avg_current[i] / 10, sum.avg_current[i] % 10);
+                total += sum.avg_current[i];
+        }
+        segger_rtt_printf("energy: total %u.%u uAh/h\n", total / 10, total % 10);
+}
+
+#endif
+
+static void
+energy_read_cb(struct service_desc *s, struct char_desc *c, void **val, uint16_t *len)
+{
+        static struct simble_energy_summary sum;
+
+        simble_energy_summary(&sum);
+        *val = &sum;
+        *len = sizeof(sum);
+}
+
+void
+simble_energy_char_add(struct service_desc *s, struct char_desc *c)
+{
+        simble_srv_char_add(s, c,
+                            simble_get_vendor_uuid_class(), VENDOR_UUID_ENERGY_CHAR,
+                            u8"Energy Diagnostics",
+                            sizeof(struct simble_energy_summary));
+        c->read_cb = energy_read_cb;
+}
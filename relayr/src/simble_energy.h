@@ -0,0 +1,68 @@
+#ifndef SIMBLE_ENERGY_H
+#define SIMBLE_ENERGY_H
+
+#include <stdint.h>
+
+#include "simble.h"
+
+/* Energy accounting.
+ *
+ * Radio activity is timed from SoftDevice radio notifications, CPU
+ * activity from the event loop around sd_app_evt_wait(), sensors and
+ * the ADC by bracketing them with simble_energy_begin()/_end().  The
+ * active times are weighted with per subsystem currents to estimate
+ * the average current, i.e. the charge used per hour.
+ *
+ * Times are RTC ticks (~1 ms); activities shorter than a tick are
+ * counted as 0 or 1 tick depending on where the tick edge falls, which
+ * averages out over many events. */
+
+enum simble_energy_sub {
+        SIMBLE_ENERGY_SLEEP,    /* base current, always counted */
+        SIMBLE_ENERGY_CPU,
+        SIMBLE_ENERGY_ADV,      /* radio events while not connected */
+        SIMBLE_ENERGY_CONN,     /* radio events while connected */
+        SIMBLE_ENERGY_SENSOR,
+        SIMBLE_ENERGY_ADC,
+        SIMBLE_ENERGY_NUM
+};
+
+/* diagnostics characteristic value, little endian */
+struct simble_energy_summary {
+        uint32_t elapsed_s;
+        uint32_t radio_events;
+        uint16_t avg_current[SIMBLE_ENERGY_NUM];        /* 0.1 uA = 0.1 uAh per hour */
+} __attribute__((packed));
+
+#ifdef SIMBLE_ENERGY
+/* after simble_init()/simble_central_init(); current_ua: active
+   current per subsystem in uA, NULL for nRF51822 datasheet figures at 3 V */
+void simble_energy_init(const uint32_t current_ua[SIMBLE_ENERGY_NUM]);
+void simble_energy_reset(void);
+void simble_energy_begin(enum simble_energy_sub sub);
+void simble_energy_end(enum simble_energy_sub sub);
+void simble_energy_cpu_sleep(void);
+void simble_energy_cpu_wake(void);
+void simble_energy_summary(struct simble_energy_summary *sum);
+void simble_energy_report(void);
+#else
+#define simble_energy_init(current_ua)
+#define simble_energy_reset()
+#define simble_energy_begin(sub)
+#define simble_energy_end(sub)
+#define simble_energy_cpu_sleep()
+#define simble_energy_cpu_wake()
+#define simble_energy_report()
+
+static inline void
+simble_energy_summary(struct simble_energy_summary *sum)
+{
+        *sum = (struct simble_energy_summary){ 0 };
+}
+#endif
+
+/* present without SIMBLE_ENERGY too, reading zeros, so the service
+   layout does not depend on the build */
+void simble_energy_char_add(struct service_desc *s, struct char_desc *c);
+
+#endif
@@ -0,0 +1,109 @@
+#include <app_util.h>
+#include <nrf_soc.h>
+
+#include "simble_evt.h"
+#include "simble_trace.h"
+#include "simble_energy.h"
+
+static struct simble_evt_handler *evt_handlers;
+static struct simble_soc_evt_handler *soc_evt_handlers;
+static struct simble_idle_handler *idle_handlers;
+
+/* one event at a time, BLE_EVT_PTR_ALIGNMENT is satisfied by the word array */
+static uint32_t evt_buf[CEIL_DIV(sizeof(ble_evt_t) + GATT_MTU_SIZE_DEFAULT, sizeof(uint32_t))];
+
+/* append, so that handlers run in registration order */
+#define LIST_APPEND(head, h)                                    \
+        do {                                                    \
+                __typeof__(h) *_pp = &(head);                   \
+                while (*_pp != NULL)                            \
+                        _pp = &(*_pp)->next;                    \
+                (h)->next = NULL;                               \
+                *_pp = (h);                                     \
+        } while (0)
+
+void
+simble_evt_register(struct simble_evt_handler *h, uint16_t first, uint16_t last, simble_evt_cb_t *cb, void *arg)
+{
+        h->first = first;
+        h->last = last;
+        h->cb = cb;
+        h->arg = arg;
+        LIST_APPEND(evt_handlers, h);
+}
+
+void
+simble_soc_evt_register(struct simble_soc_evt_handler *h, simble_soc_evt_cb_t *cb, void *arg)
+{
+        h->cb = cb;
+        h->arg = arg;
+        LIST_APPEND(soc_evt_handlers, h);
+}
+
+void
+simble_idle_register(struct simble_idle_handler *h, simble_idle_cb_t *cb, void *arg)
+{
+        h->cb = cb;
+        h->arg = arg;
+        LIST_APPEND(idle_handlers, h);
+}
+
+void
+simble_evt_dispatch(ble_evt_t *evt)
+{
+        uint16_t id = evt->header.evt_id;
+
+        for (struct simble_evt_handler *h = evt_handlers; h != NULL; h = h->next) {
+                if (id >= h->first && id <= h->last)
+                        h->cb(evt, h->arg);
+        }
+}
+
+/* drain all pending events, then run the idle hooks */
+void
+simble_evt_process(void)
+{
+        ble_evt_t *evt = (ble_evt_t *)evt_buf;
+        uint32_t evt_id;
+        uint16_t len;
+
+        /* SWI2 signals SoftDevice events but is not enabled; left
+           pending it ends every sd_app_evt_wait() at once.
+           Cleared before draining, later events pend it again */
+        sd_nvic_ClearPendingIRQ(SWI2_IRQn);
+        while (sd_evt_get(&evt_id) == NRF_SUCCESS) {
+                for (struct simble_soc_evt_handler *h = soc_evt_handlers; h != NULL; h = h->next)
+                        h->cb(evt_id, h->arg);
+        }
+
+        for (;;) {
+                len = sizeof(evt_buf);
+                if (sd_ble_evt_get((uint8_t *)evt_buf, &len) != NRF_SUCCESS)
+                        break;
+                simble_trace_ble_evt(evt);
+                simble_evt_dispatch(evt);
+        }
+
+        for (struct simble_idle_handler *h = idle_handlers; h != NULL; h = h->next)
+                h->cb(h->arg);
+}
+
+uint32_t
+simble_evt_wait(void)
+{
+        uint32_t err_code;
+
+        simble_energy_cpu_sleep();
+        err_code = sd_app_evt_wait();
+        simble_energy_cpu_wake();
+        return (err_code);
+}
+
+void
+simble_evt_loop(void)
+{
+        for (;;) {
+                simble_evt_process();
+                simble_evt_wait();
+        }
+}
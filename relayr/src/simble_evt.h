@@ -0,0 +1,54 @@
+#ifndef SIMBLE_EVT_H
+#define SIMBLE_EVT_H
+
+#include <ble.h>
+
+/* Event dispatcher shared by the peripheral (simble) and central
+ * (simble_central) builds.
+ *
+ * Modules register handlers for a range of BLE event IDs, SoC event
+ * handlers and idle hooks that run once the pending events have been
+ * drained, before the CPU goes to sleep.  Handlers are called in
+ * registration order; the descriptors are owned by the caller and
+ * must stay valid. */
+
+typedef void (simble_evt_cb_t)(ble_evt_t *evt, void *arg);
+typedef void (simble_soc_evt_cb_t)(uint32_t evt_id, void *arg);
+typedef void (simble_idle_cb_t)(void *arg);
+
+struct simble_evt_handler {
+        struct simble_evt_handler *next;
+        uint16_t first;
+        uint16_t last;
+        simble_evt_cb_t *cb;
+        void *arg;
+};
+
+struct simble_soc_evt_handler {
+        struct simble_soc_evt_handler *next;
+        simble_soc_evt_cb_t *cb;
+        void *arg;
+};
+
+struct simble_idle_handler {
+        struct simble_idle_handler *next;
+        simble_idle_cb_t *cb;
+        void *arg;
+};
+
+#define SIMBLE_EVT_RANGE_COMMON BLE_EVT_BASE, BLE_EVT_LAST
+#define SIMBLE_EVT_RANGE_GAP    BLE_GAP_EVT_BASE, BLE_GAP_EVT_LAST
+#define SIMBLE_EVT_RANGE_GATTC  BLE_GATTC_EVT_BASE, BLE_GATTC_EVT_LAST
+#define SIMBLE_EVT_RANGE_GATTS  BLE_GATTS_EVT_BASE, BLE_GATTS_EVT_LAST
+#define SIMBLE_EVT_RANGE_ALL    0, 0xffff
+
+void simble_evt_register(struct simble_evt_handler *h, uint16_t first, uint16_t last, simble_evt_cb_t *cb, void *arg);
+void simble_soc_evt_register(struct simble_soc_evt_handler *h, simble_soc_evt_cb_t *cb, void *arg);
+void simble_idle_register(struct simble_idle_handler *h, simble_idle_cb_t *cb, void *arg);
+
+void simble_evt_dispatch(ble_evt_t *evt);
+void simble_evt_process(void);
+uint32_t simble_evt_wait(void);
+void simble_evt_loop(void) __attribute__ ((noreturn));
+
+#endif
@@ -0,0 +1,54 @@
+#include <string.h>
+
+#include "simble_trace.h"
+#include "segger_rtt_init.h"
+#include "rtc.h"
+
+#ifdef SIMBLE_TRACE
+
+static uint8_t trace_buf[SIMBLE_TRACE_BUF_SIZE];
+static uint32_t trace_dropped;
+
+void
+simble_trace_init(void)
+{
+        SEGGER_RTT_ConfigUpBuffer(SIMBLE_TRACE_RTT_CHANNEL, "simble-trace",
+                                  trace_buf, sizeof(trace_buf),
+                                  SEGGER_RTT_MODE_NO_BLOCK_SKIP);
+}
+
+void
+simble_trace_ble_evt(const ble_evt_t *evt)
+{
+        struct {
+                struct simble_trace_rec rec;
+                uint8_t payload[SIMBLE_TRACE_MAX_PAYLOAD];
+        } __attribute__((packed)) r;
+        uint16_t len = evt->header.evt_len;
+
+        if (len > SIMBLE_TRACE_MAX_PAYLOAD)
+                len = SIMBLE_TRACE_MAX_PAYLOAD;
+
+        r.rec = (struct simble_trace_rec){
+                .sync = SIMBLE_TRACE_SYNC,
+                .len = len,
+                .evt_id = evt->header.evt_id,
+                .evt_len = evt->header.evt_len,
+                /* every event group starts with the connection handle */
+                .conn_handle = evt->evt.common_evt.conn_handle,
+                .timestamp = rtc_now(),
+        };
+        memcpy(r.payload, &evt->evt, len);
+
+        /* SKIP mode: the record is written whole or not at all */
+        if (SEGGER_RTT_Write(SIMBLE_TRACE_RTT_CHANNEL, &r, sizeof(r.rec) + len) == 0)
+                trace_dropped++;
+}
+
+uint32_t
+simble_trace_dropped(void)
+{
+        return (trace_dropped);
+}
+
+#endif
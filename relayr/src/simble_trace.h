@@ -0,0 +1,35 @@
+#ifndef SIMBLE_TRACE_H
+#define SIMBLE_TRACE_H
+
+#include <ble.h>
+
+/* Binary BLE event trace, streamed over RTT up channel 1.
+ *
+ * Every record is a header followed by the first `len` bytes of the
+ * event union (after ble_evt_hdr_t), all little endian. */
+
+#define SIMBLE_TRACE_RTT_CHANNEL 1
+#define SIMBLE_TRACE_BUF_SIZE 1024
+#define SIMBLE_TRACE_MAX_PAYLOAD 48
+#define SIMBLE_TRACE_SYNC 0xb7
+
+struct simble_trace_rec {
+        uint8_t sync;
+        uint8_t len;            /* payload bytes following the header */
+        uint16_t evt_id;
+        uint16_t evt_len;       /* untruncated ble_evt_hdr_t.evt_len */
+        uint16_t conn_handle;
+        uint32_t timestamp;     /* rtc_now() ticks */
+} __attribute__((packed));
+
+#ifdef SIMBLE_TRACE
+void simble_trace_init(void);
+void simble_trace_ble_evt(const ble_evt_t *evt);
+uint32_t simble_trace_dropped(void);
+#else
+#define simble_trace_init()
+#define simble_trace_ble_evt(evt)
+#define simble_trace_dropped() 0
+#endif
+
+#endif
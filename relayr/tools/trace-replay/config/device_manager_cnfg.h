@@ -0,0 +1,11 @@
+/* Host replay: device manager configuration matching the S120 gateway. */
+#ifndef DEVICE_MANAGER_CNFG_H__
+#define DEVICE_MANAGER_CNFG_H__
+
+#define DEVICE_MANAGER_MAX_APPLICATIONS	1
+#define DEVICE_MANAGER_MAX_CONNECTIONS	8
+#define DEVICE_MANAGER_MAX_BONDS	7
+#define DM_GATT_CCCD_COUNT		4
+#define DM_GATT_SERVER_ATTR_MAX_SIZE	0x180
+
+#endif
@@ -0,0 +1,28 @@
+/* Host replay: minimal pstorage configuration, flash is stubbed. */
+#ifndef PSTORAGE_PL_H__
+#define PSTORAGE_PL_H__
+
+#include <stdint.h>
+
+#define PSTORAGE_FLASH_PAGE_SIZE	1024
+#define PSTORAGE_FLASH_EMPTY_MASK	0xFFFFFFFF
+#define PSTORAGE_MAX_APPLICATIONS	2
+#define PSTORAGE_MIN_BLOCK_SIZE		0x0010
+#define PSTORAGE_DATA_START_ADDR	0x3c000
+#define PSTORAGE_DATA_END_ADDR		0x3fc00
+#define PSTORAGE_SWAP_ADDR		PSTORAGE_DATA_END_ADDR
+#define PSTORAGE_MAX_BLOCK_SIZE		PSTORAGE_FLASH_PAGE_SIZE
+#define PSTORAGE_CMD_QUEUE_SIZE		10
+
+typedef uint32_t pstorage_block_t;
+
+typedef struct {
+	uint32_t module_id;
+	pstorage_block_t block_id;
+} pstorage_handle_t;
+
+typedef uint16_t pstorage_size_t;
+
+void pstorage_sys_event_handler(uint32_t sys_evt);
+
+#endif
@@ -0,0 +1,194 @@
+/*
+ * Accuracy test and benchmark of the fixmath.h conversions against the
+ * formulas they replace: the battery service ADC scaling and the SDK's
+ * battery_level_in_percent(), and a curve with falling segments
+ * against the documented fix_pwl_eval() rounding.  Exits non-zero on
+ * a mismatch; -b also times both battery level versions.
+ *
+ * The timings are host timings with a hardware divider, where the
+ * division formula is usually the faster one.  They catch regressions
+ * of the table walk; the gain is on the Cortex-M0, which calls libgcc
+ * for each division.
+ */
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <app_util.h>
+
+#include "fixmath.h"
+#include "batt_serv.h"
+
+#define BENCH_ROUNDS	200
+
+static volatile uint32_t sink;
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* the formula batt_serv used before fixmath.h */
+static uint32_t
+adc_mv_div(uint32_t raw)
+{
+	return ((raw * ADC_REF_VOLTAGE_IN_MILLIVOLTS) / 255) * ADC_PRE_SCALING_COMPENSATION;
+}
+
+static int
+test_adc_scale(void)
+{
+	for (uint32_t raw = 0; raw <= 0xff; raw++) {
+		if (ADC_RESULT_IN_MILLI_VOLTS(raw) != adc_mv_div(raw)) {
+			warnx("adc %u: %u mV, expected %u mV", raw,
+				ADC_RESULT_IN_MILLI_VOLTS(raw), adc_mv_div(raw));
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int
+test_batt_level(void)
+{
+	for (uint32_t mv = 0; mv <= UINT16_MAX; mv++) {
+		if (batt_level_in_percent(mv) != battery_level_in_percent(mv)) {
+			warnx("%u mV: %u%%, expected %u%%", mv,
+				batt_level_in_percent(mv), battery_level_in_percent(mv));
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* a thermistor like curve, falling and rising again */
+static const struct fix_pwl_seg mixed_curve[] = {
+	FIX_PWL_SEG(100, 50, 300, -20),
+	FIX_PWL_SEG(300, -20, 400, -100),
+	FIX_PWL_SEG(400, -100, 800, -110),
+	FIX_PWL_SEG(800, -110, 900, -50),
+};
+#define MIXED_SEGS	(sizeof(mixed_curve) / sizeof(mixed_curve[0]))
+
+/* the documented formula, with C division */
+static int32_t
+pwl_ref(const struct fix_pwl_seg *tab, unsigned count, uint32_t x)
+{
+	if (x <= tab[0].x_lo)
+		return tab[0].y_lo;
+	for (unsigned i = 0; i < count; i++) {
+		const struct fix_pwl_seg *seg = &tab[i];
+
+		if (x <= seg->x_hi)
+			return seg->y_hi - (int32_t)(seg->x_hi - x) *
+				(seg->y_hi - seg->y_lo) / (seg->x_hi - seg->x_lo);
+	}
+	return tab[count - 1].y_hi;
+}
+
+static int
+test_pwl(void)
+{
+	for (uint32_t x = 0; x <= UINT16_MAX; x++) {
+		int32_t y = fix_pwl_eval(mixed_curve, MIXED_SEGS, x);
+
+		if (y != pwl_ref(mixed_curve, MIXED_SEGS, x)) {
+			warnx("pwl %u: %d, expected %d", x, y,
+				pwl_ref(mixed_curve, MIXED_SEGS, x));
+			return 0;
+		}
+	}
+	/* 49.65 on a falling segment rounds toward y_hi, i.e. down */
+	if (fix_pwl_eval(mixed_curve, MIXED_SEGS, 101) != 49) {
+		warnx("pwl 101: %d, expected 49", fix_pwl_eval(mixed_curve, MIXED_SEGS, 101));
+		return 0;
+	}
+	return 1;
+}
+
+/* floor(x / d) is exact below the documented bound */
+static int
+test_recip(void)
+{
+	static const uint32_t divs[] = { 3, 7, 10, 17, 100, 255, 1000 };
+
+	for (unsigned i = 0; i < sizeof(divs) / sizeof(divs[0]); i++) {
+		uint32_t d = divs[i];
+		uint32_t recip = FIX_RECIP(d, 16);
+		uint32_t log2d = 32 - __builtin_clz(d - 1);
+		uint32_t limit = (uint32_t)1 << (16 - log2d);
+
+		for (uint32_t x = 0; x < limit; x++) {
+			if (fix_mulshift(x, recip, 16) != x / d) {
+				warnx("%u / %u: %u", x, d, fix_mulshift(x, recip, 16));
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+static int
+test_sat(void)
+{
+	return fix_sat_u8(-1) == 0 && fix_sat_u8(256) == UINT8_MAX &&
+		fix_sat_u16(70000) == UINT16_MAX && fix_sat_i16(-40000) == INT16_MIN &&
+		fix_add_sat_u16(UINT16_MAX, 1) == UINT16_MAX &&
+		fix_sub_sat_u16(1, 2) == 0 &&
+		fix_add_sat_i16(INT16_MAX, 1) == INT16_MAX &&
+		fix_add_sat_i16(INT16_MIN, -1) == INT16_MIN;
+}
+
+static void
+bench(void)
+{
+	uint64_t t, div_ns, fix_ns;
+	uint32_t acc;
+
+	acc = 0;
+	t = now_ns();
+	for (int r = 0; r < BENCH_ROUNDS; r++)
+		for (uint32_t mv = 0; mv <= UINT16_MAX; mv++)
+			acc += battery_level_in_percent(mv + sink);
+	div_ns = now_ns() - t;
+	sink = acc;
+
+	acc = 0;
+	t = now_ns();
+	for (int r = 0; r < BENCH_ROUNDS; r++)
+		for (uint32_t mv = 0; mv <= UINT16_MAX; mv++)
+			acc += batt_level_in_percent(mv + sink);
+	fix_ns = now_ns() - t;
+	sink = acc;
+
+	printf("battery level: division %.2f ns, pwl %.2f ns per call\n",
+		(double)div_ns / (BENCH_ROUNDS * 65536.0),
+		(double)fix_ns / (BENCH_ROUNDS * 65536.0));
+}
+
+int
+main(int argc, char **argv)
+{
+	int ok = 1;
+
+	ok &= test_adc_scale();
+	ok &= test_batt_level();
+	ok &= test_recip();
+	ok &= test_pwl();
+	if (!test_sat()) {
+		warnx("saturating helpers");
+		ok = 0;
+	}
+	if (!ok)
+		return 1;
+	printf("fixmath: all conversions match\n");
+	if (argc > 1 && strcmp(argv[1], "-b") == 0)
+		bench();
+	return 0;
+}
@@ -0,0 +1,237 @@
+/*
+ * Round-trip test of the gatt_codec.h encoders: integers in both byte
+ * orders, every representable SFLOAT and a sweep of FLOAT values, the
+ * overflow policy shared by both (+-INF, NRes for a SFLOAT exponent
+ * below range), and the vendor sensor payloads, whose *_LEN must match
+ * what their gatt_put_* sequence writes.  Exits non-zero on a mismatch.
+ */
+#include <err.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gatt_codec.h"
+
+/* guard bytes catch an encoder writing past its length */
+#define GUARD		0xa5
+
+static uint8_t buf[32];
+
+static void
+clear(void)
+{
+	memset(buf, GUARD, sizeof(buf));
+}
+
+static int
+check_len(const char *what, const uint8_t *end, size_t len)
+{
+	if (end != buf + len) {
+		warnx("%s: wrote %td bytes, expected %zu", what, end - buf, len);
+		return 0;
+	}
+	if (buf[len] != GUARD) {
+		warnx("%s: wrote past %zu bytes", what, len);
+		return 0;
+	}
+	return 1;
+}
+
+static int
+test_int(void)
+{
+	static const uint8_t le[] = { 0x78, 0x56, 0x34, 0x12 };
+	static const uint8_t be[] = { 0x12, 0x34, 0x56, 0x78 };
+	uint8_t *e;
+
+	clear();
+	e = gatt_put_u8(buf, 0x9c);
+	if (!check_len("u8", e, GATT_U8_LEN) || buf[0] != 0x9c)
+		return 0;
+
+	clear();
+	e = gatt_put_le16(buf, 0x5678);
+	if (!check_len("le16", e, GATT_U16_LEN) || memcmp(buf, le, 2) != 0 ||
+	    gatt_get_le16(buf) != 0x5678)
+		return 0;
+
+	clear();
+	e = gatt_put_le24(buf, 0x345678);
+	if (!check_len("le24", e, GATT_U24_LEN) || memcmp(buf, le, 3) != 0 ||
+	    gatt_get_le24(buf) != 0x345678)
+		return 0;
+
+	clear();
+	e = gatt_put_le32(buf, 0x12345678);
+	if (!check_len("le32", e, GATT_U32_LEN) || memcmp(buf, le, 4) != 0 ||
+	    gatt_get_le32(buf) != 0x12345678)
+		return 0;
+
+	clear();
+	e = gatt_put_be16(buf, 0x1234);
+	if (!check_len("be16", e, GATT_U16_LEN) || memcmp(buf, be, 2) != 0 ||
+	    gatt_get_be16(buf) != 0x1234)
+		return 0;
+
+	clear();
+	e = gatt_put_be32(buf, 0x12345678);
+	if (!check_len("be32", e, GATT_U32_LEN) || memcmp(buf, be, 4) != 0 ||
+	    gatt_get_be32(buf) != 0x12345678)
+		return 0;
+	return 1;
+}
+
+static int
+test_sfloat(void)
+{
+	int16_t m;
+	int8_t x;
+
+	for (int exp = GATT_SFLOAT_EXP_MIN; exp <= GATT_SFLOAT_EXP_MAX; exp++) {
+		for (int mant = GATT_SFLOAT_MANT_MIN; mant <= GATT_SFLOAT_MANT_MAX; mant++) {
+			clear();
+			if (!check_len("sfloat", gatt_put_sfloat(buf, mant, exp), GATT_U16_LEN))
+				return 0;
+			if (!gatt_get_sfloat(buf, &m, &x)) {
+				warnx("sfloat %de%d: decoded as special", mant, exp);
+				return 0;
+			}
+			/* zero has a single encoding */
+			if (m != mant || (mant != 0 && x != exp) || (mant == 0 && x != 0)) {
+				warnx("sfloat %de%d: got %de%d", mant, exp, m, x);
+				return 0;
+			}
+		}
+	}
+
+	static const struct {
+		int16_t mant;
+		int8_t exp;
+		uint16_t v;
+	} special[] = {
+		{ GATT_SFLOAT_MANT_MAX + 1, 0, GATT_SFLOAT_PINF },
+		{ INT16_MAX, -8, GATT_SFLOAT_PINF },
+		{ GATT_SFLOAT_MANT_MIN - 1, 0, GATT_SFLOAT_NINF },
+		{ INT16_MIN, 7, GATT_SFLOAT_NINF },
+		{ 1, GATT_SFLOAT_EXP_MAX + 1, GATT_SFLOAT_PINF },
+		{ -1, GATT_SFLOAT_EXP_MAX + 1, GATT_SFLOAT_NINF },
+		{ 1, GATT_SFLOAT_EXP_MIN - 1, GATT_SFLOAT_NRES },
+		{ 0, GATT_SFLOAT_EXP_MAX + 1, 0 },
+	};
+	for (size_t i = 0; i < sizeof(special) / sizeof(special[0]); i++) {
+		uint16_t v = gatt_sfloat(special[i].mant, special[i].exp);
+
+		if (v != special[i].v) {
+			warnx("sfloat %de%d: %#06x, expected %#06x",
+				special[i].mant, special[i].exp, v, special[i].v);
+			return 0;
+		}
+	}
+
+	static const uint16_t reserved[] = {
+		GATT_SFLOAT_NAN, GATT_SFLOAT_NRES, GATT_SFLOAT_PINF,
+		GATT_SFLOAT_NINF, 0x0801,
+	};
+	for (size_t i = 0; i < sizeof(reserved) / sizeof(reserved[0]); i++) {
+		gatt_put_le16(buf, reserved[i]);
+		if (gatt_get_sfloat(buf, &m, &x)) {
+			warnx("sfloat %#06x: decoded as %de%d", reserved[i], m, x);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int
+test_float(void)
+{
+	int32_t m;
+	int8_t x;
+
+	for (int exp = INT8_MIN; exp <= INT8_MAX; exp += 15) {
+		for (int32_t mant = GATT_FLOAT_MANT_MIN; mant <= GATT_FLOAT_MANT_MAX; mant += 4093) {
+			clear();
+			if (!check_len("float", gatt_put_float(buf, mant, exp), GATT_U32_LEN))
+				return 0;
+			if (!gatt_get_float(buf, &m, &x) || m != mant || x != exp) {
+				warnx("float %de%d: bad round trip", mant, exp);
+				return 0;
+			}
+		}
+	}
+
+	if (gatt_float(GATT_FLOAT_MANT_MAX + 1, 0) != GATT_FLOAT_PINF ||
+	    gatt_float(INT32_MAX, -1) != GATT_FLOAT_PINF ||
+	    gatt_float(GATT_FLOAT_MANT_MIN - 1, 0) != GATT_FLOAT_NINF ||
+	    gatt_float(INT32_MIN, 1) != GATT_FLOAT_NINF) {
+		warnx("float overflow does not saturate to INF");
+		return 0;
+	}
+
+	static const uint32_t reserved[] = {
+		GATT_FLOAT_NAN, GATT_FLOAT_NRES, GATT_FLOAT_PINF,
+		GATT_FLOAT_NINF, 0x00800001,
+	};
+	for (size_t i = 0; i < sizeof(reserved) / sizeof(reserved[0]); i++) {
+		gatt_put_le32(buf, reserved[i]);
+		if (gatt_get_float(buf, &m, &x)) {
+			warnx("float %#010x: decoded as %de%d", reserved[i], m, x);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int
+test_sensors(void)
+{
+	static const int16_t accel[3] = { -1000, 0, 981 };
+	static const int16_t gyro[3] = { INT16_MIN, 1, INT16_MAX };
+	struct gatt_color c;
+	struct gatt_motion mo;
+
+	clear();
+	if (!check_len("temp", gatt_put_temp(buf, -4015), GATT_TEMP_LEN) ||
+	    gatt_get_temp(buf) != -4015)
+		return 0;
+
+	clear();
+	if (!check_len("humid", gatt_put_humid(buf, 10000), GATT_HUMID_LEN) ||
+	    gatt_get_humid(buf) != 10000)
+		return 0;
+
+	clear();
+	if (!check_len("color", gatt_put_color(buf, 1, 0x100, 0xfffe, 0xffff),
+		GATT_COLOR_LEN))
+		return 0;
+	gatt_get_color(buf, &c);
+	if (c.red != 1 || c.green != 0x100 || c.blue != 0xfffe || c.clear != 0xffff) {
+		warnx("color: got %u %u %u %u", c.red, c.green, c.blue, c.clear);
+		return 0;
+	}
+
+	clear();
+	if (!check_len("motion", gatt_put_motion(buf, accel, gyro), GATT_MOTION_LEN))
+		return 0;
+	gatt_get_motion(buf, &mo);
+	if (memcmp(mo.accel, accel, sizeof(accel)) != 0 ||
+	    memcmp(mo.gyro, gyro, sizeof(gyro)) != 0) {
+		warnx("motion: bad round trip");
+		return 0;
+	}
+	return 1;
+}
+
+int
+main(void)
+{
+	int ok = 1;
+
+	ok &= test_int();
+	ok &= test_sfloat();
+	ok &= test_float();
+	ok &= test_sensors();
+	if (!ok)
+		return 1;
+	printf("gatt_codec: all round trips match\n");
+	return 0;
+}
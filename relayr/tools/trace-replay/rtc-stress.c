@@ -0,0 +1,336 @@
+/*
+ * Stress test of rtc.c against a simulated RTC1.  A thread plays the
+ * peripheral: it counts ticks, raises the compare and overflow events
+ * and interrupts the main thread with SIGUSR1 while an enabled event is
+ * set.  The NVIC and critical region calls block the signal, the way
+ * they hold off RTC1_IRQHandler on the chip.
+ *
+ * The main thread meanwhile arms one-shots, which the callbacks chain
+ * from the IRQ handler, and enables, pauses, stops and retimes a
+ * periodic timer, checking that
+ *  - every armed one-shot fires once,
+ *  - one-shots never take the periodic timer's slot,
+ *  - the periodic timer fires while enabled and only then,
+ *  - rtc_now() does not go back when COUNTER wraps,
+ *  - all slots are FREE again once everything is released.
+ *
+ * The simulated tick is 100 us rather than ~1 ms; a host that stalls
+ * the test for more than STALL_TICKS can still report a stall.
+ */
+#include <err.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <nrf.h>
+
+static NRF_RTC_Type sim_rtc;
+
+#undef NRF_RTC1
+#define NRF_RTC1	(&sim_rtc)
+
+#include "rtc.c"
+
+#define TICK_NS		100000
+#define RUN_TICKS	20000
+#define DRAIN_TICKS	5000
+#define STALL_TICKS	1000
+/* the COUNTER wraps halfway through the run */
+#define START_COUNTER	(RTC_COUNTER_MASK - RUN_TICKS / 2)
+
+#define ONESHOT_MAX	30
+#define PERIOD_MAX	40
+#define PERIODIC_ID	0
+
+static struct rtc_ctx rtc;
+static pthread_t main_thread;
+static sigset_t irq_sigs;
+static volatile int sim_run;
+static volatile uint32_t sim_ticks;
+
+/* main thread state, the IRQ handler runs on it */
+static volatile int in_isr;
+static int irq_disabled;
+static int crit_depth;
+
+static volatile uint32_t oneshot_armed, oneshot_fired;
+static volatile int oneshot_chain;
+static volatile int periodic_on;
+static volatile uint32_t periodic_last, periodic_fired, periodic_stray;
+
+static uint32_t
+xorshift(uint32_t *s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 17;
+	*s ^= *s << 5;
+	return *s;
+}
+
+static uint32_t main_rnd = 0x2545f491;
+static uint32_t isr_rnd = 0x9e3779b9;
+
+static int
+sim_irq_pending(void)
+{
+	if (sim_rtc.EVENTS_OVRFLW && (rtc_inten & RTC_INTENSET_OVRFLW_Msk))
+		return 1;
+	for (int id = 0; id < RTC_CHANNEL_NUM; id++)
+		if (sim_rtc.EVENTS_COMPARE[id] &&
+		    (rtc_inten & (RTC_INTENSET_COMPARE0_Msk << id)))
+			return 1;
+	return 0;
+}
+
+static void *
+sim_rtc_thread(void *arg)
+{
+	const struct timespec tick = { 0, TICK_NS };
+
+	while (sim_run) {
+		nanosleep(&tick, NULL);
+
+		uint32_t c = (sim_rtc.COUNTER + 1) & RTC_COUNTER_MASK;
+
+		/* the event is visible no later than the wrapped COUNTER */
+		if (c == 0)
+			sim_rtc.EVENTS_OVRFLW = 1;
+		sim_rtc.COUNTER = c;
+		for (int id = 0; id < RTC_CHANNEL_NUM; id++)
+			if (sim_rtc.CC[id] == c)
+				sim_rtc.EVENTS_COMPARE[id] = 1;
+		sim_ticks++;
+
+		if (sim_irq_pending())
+			pthread_kill(main_thread, SIGUSR1);
+	}
+	return NULL;
+}
+
+static void
+sim_irq(int sig)
+{
+	in_isr = 1;
+	RTC1_IRQHandler();
+	in_isr = 0;
+}
+
+static void
+sim_mask(int block)
+{
+	pthread_sigmask(block ? SIG_BLOCK : SIG_UNBLOCK, &irq_sigs, NULL);
+}
+
+/* no boot timing on the host */
+void
+simble_boot_stop(void)
+{
+}
+
+uint32_t
+sd_nvic_ClearPendingIRQ(IRQn_Type irq)
+{
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_nvic_SetPriority(IRQn_Type irq, uint32_t prio)
+{
+	return NRF_SUCCESS;
+}
+
+/* the handler does not preempt itself, nothing to do from within it */
+uint32_t
+sd_nvic_DisableIRQ(IRQn_Type irq)
+{
+	if (!in_isr) {
+		sim_mask(1);
+		irq_disabled = 1;
+	}
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_nvic_EnableIRQ(IRQn_Type irq)
+{
+	if (!in_isr) {
+		irq_disabled = 0;
+		if (crit_depth == 0)
+			sim_mask(0);
+	}
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_nvic_critical_region_enter(uint8_t *nested)
+{
+	sim_mask(1);
+	*nested = crit_depth++ > 0;
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_nvic_critical_region_exit(uint8_t nested)
+{
+	if (--crit_depth == 0 && !in_isr && !irq_disabled)
+		sim_mask(0);
+	return NRF_SUCCESS;
+}
+
+static void
+oneshot_cb(struct rtc_ctx *ctx)
+{
+	__atomic_add_fetch(&oneshot_fired, 1, __ATOMIC_RELAXED);
+	if (oneshot_chain && (xorshift(&isr_rnd) & 3) == 0 &&
+	    rtc_oneshot_timer(1 + xorshift(&isr_rnd) % ONESHOT_MAX, oneshot_cb))
+		__atomic_add_fetch(&oneshot_armed, 1, __ATOMIC_RELAXED);
+}
+
+static void
+periodic_cb(struct rtc_ctx *ctx)
+{
+	if (!periodic_on)
+		periodic_stray++;
+	periodic_fired++;
+	periodic_last = sim_ticks;
+}
+
+static void
+spin(uint32_t n)
+{
+	for (volatile uint32_t i = 0; i < n; i++)
+		;
+}
+
+static int
+stress(void)
+{
+	uint32_t last = rtc_now();
+	uint32_t now;
+
+	while (sim_ticks < RUN_TICKS) {
+		switch (xorshift(&main_rnd) % 16) {
+		case 0:
+		case 1:
+		case 2:
+			if (rtc_oneshot_timer(1 + xorshift(&main_rnd) % ONESHOT_MAX, oneshot_cb))
+				__atomic_add_fetch(&oneshot_armed, 1, __ATOMIC_RELAXED);
+			break;
+		case 3:
+		case 4:
+		case 5:
+			periodic_last = sim_ticks;
+			periodic_on = 1;
+			if (!rtc_update_cfg(1 + xorshift(&main_rnd) % PERIOD_MAX, PERIODIC_ID, true))
+				goto borrowed;
+			break;
+		case 6:
+			if (!rtc_update_cfg(1 + xorshift(&main_rnd) % PERIOD_MAX, PERIODIC_ID, false))
+				goto borrowed;
+			periodic_on = 0;
+			break;
+		case 7:
+			if (!rtc_update_cfg(0, PERIODIC_ID, false))
+				goto borrowed;
+			periodic_on = 0;
+			break;
+		case 8:
+		case 9:
+		case 10:
+			if (periodic_on)
+				rtc_retime(1 + xorshift(&main_rnd) % PERIOD_MAX, PERIODIC_ID);
+			break;
+		default:
+			spin(xorshift(&main_rnd) % 100000);
+			break;
+		}
+
+		now = rtc_now();
+		if ((int32_t)(now - last) < 0) {
+			warnx("rtc_now went back from %#x to %#x", last, now);
+			return 0;
+		}
+		last = now;
+
+		if (periodic_on && sim_ticks - periodic_last > PERIOD_MAX + STALL_TICKS) {
+			warnx("periodic timer stalled at tick %u", sim_ticks);
+			return 0;
+		}
+	}
+
+	if (periodic_stray != 0) {
+		warnx("%u periodic callbacks while disabled", periodic_stray);
+		return 0;
+	}
+	return 1;
+
+borrowed:
+	warnx("a one-shot took the periodic slot");
+	return 0;
+}
+
+static int
+drain(void)
+{
+	uint32_t deadline;
+
+	oneshot_chain = 0;
+	deadline = sim_ticks + DRAIN_TICKS;
+	while (oneshot_fired != oneshot_armed && sim_ticks < deadline)
+		spin(1000);
+	if (oneshot_fired != oneshot_armed) {
+		warnx("%u one-shots armed, %u fired", oneshot_armed, oneshot_fired);
+		return 0;
+	}
+
+	rtc_update_cfg(0, PERIODIC_ID, false);
+	periodic_on = 0;
+
+	for (int id = 0; id < RTC_MAX_TIMERS; id++) {
+		if (rtc.rtc_x[id].state != RTC_SLOT_FREE) {
+			warnx("slot %d leaked in state %d", id, rtc.rtc_x[id].state);
+			return 0;
+		}
+	}
+	if (rtc_inten != RTC_INTENSET_OVRFLW_Msk) {
+		warnx("compare interrupts left enabled: %#x", rtc_inten);
+		return 0;
+	}
+	return 1;
+}
+
+int
+main(void)
+{
+	struct sigaction sa = { .sa_handler = sim_irq };
+	pthread_t hw;
+	int ok;
+
+	sigemptyset(&irq_sigs);
+	sigaddset(&irq_sigs, SIGUSR1);
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGUSR1, &sa, NULL);
+	main_thread = pthread_self();
+
+	rtc.rtc_x[PERIODIC_ID].cb = periodic_cb;
+	rtc_init(&rtc);
+	/* rtc_init() cleared and started the counter, start near the wrap */
+	sim_rtc.TASKS_CLEAR = sim_rtc.TASKS_START = 0;
+	sim_rtc.COUNTER = START_COUNTER;
+
+	oneshot_chain = 1;
+	sim_run = 1;
+	if (pthread_create(&hw, NULL, sim_rtc_thread, NULL) != 0)
+		errx(1, "pthread_create");
+
+	ok = stress() && drain();
+
+	sim_run = 0;
+	pthread_join(hw, NULL);
+	if (!ok)
+		return 1;
+	printf("rtc: %u one-shots, %u periodic expiries over %u ticks\n",
+		oneshot_fired, periodic_fired, sim_ticks);
+	return 0;
+}
@@ -0,0 +1,379 @@
+/*
+ * SoftDevice, device manager and RTC stand-ins for the host replay.
+ * Every call is logged when stub_verbose is set, so a replay run can be
+ * diffed against a previous one.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ble.h>
+#include <nrf_sdm.h>
+#include <nrf_soc.h>
+#include <app_error.h>
+#include <device_manager.h>
+#include <pstorage.h>
+
+#include "rtc.h"
+#include "onboard-led.h"
+#include "simble_boot.h"
+#include "sd-stub.h"
+
+int stub_verbose;
+uint32_t stub_now;
+
+#define STUB_LOG(...) do {						\
+		if (stub_verbose) {					\
+			printf("%10u ", stub_now);			\
+			printf(__VA_ARGS__);				\
+			printf("\n");					\
+		}							\
+	} while (0)
+
+uint32_t
+rtc_now(void)
+{
+	return stub_now;
+}
+
+bool
+rtc_oneshot_timer(uint32_t value, rtc_evt_cb_t *cb)
+{
+	STUB_LOG("rtc_oneshot_timer(%u)", value);
+	return false;
+}
+
+/* simble_boot.c runs RTC1 itself */
+void
+simble_boot_start(void)
+{
+	STUB_LOG("simble_boot_start()");
+}
+
+void
+simble_boot_stop(void)
+{
+	STUB_LOG("simble_boot_stop()");
+}
+
+void
+simble_boot_mark(enum simble_boot_phase phase)
+{
+	STUB_LOG("simble_boot_mark(%d)", phase);
+}
+
+void
+simble_boot_report(void)
+{
+}
+
+void
+onboard_led(enum onboard_led set)
+{
+	STUB_LOG("onboard_led(%d)", set);
+}
+
+void
+onboard_led_pattern(enum onboard_led_pattern pattern)
+{
+	STUB_LOG("onboard_led_pattern(%d)", pattern);
+}
+
+void
+app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t *p_file_name)
+{
+	fprintf(stderr, "app error %#x at %s:%u\n", error_code, p_file_name, line_num);
+	abort();
+}
+
+uint32_t
+sd_softdevice_enable(nrf_clock_lfclksrc_t clock_source, softdevice_assertion_handler_t assertion_handler)
+{
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ble_enable(ble_enable_params_t *p_ble_enable_params)
+{
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_app_evt_wait(void)
+{
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_evt_get(uint32_t *p_evt_id)
+{
+	return NRF_ERROR_NOT_FOUND;
+}
+
+uint32_t
+sd_ble_evt_get(uint8_t *p_dest, uint16_t *p_len)
+{
+	return NRF_ERROR_NOT_FOUND;
+}
+
+uint32_t
+sd_nvic_ClearPendingIRQ(IRQn_Type IRQn)
+{
+	return NRF_SUCCESS;
+}
+
+/* the replay is single threaded, pool.c runs unchanged */
+uint32_t
+sd_nvic_critical_region_enter(uint8_t *p_is_nested_critical_region)
+{
+	*p_is_nested_critical_region = 0;
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_nvic_critical_region_exit(uint8_t is_nested_critical_region)
+{
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ble_uuid_vs_add(const ble_uuid128_t *p_vs_uuid, uint8_t *p_uuid_type)
+{
+	*p_uuid_type = BLE_UUID_TYPE_VENDOR_BEGIN;
+	return NRF_SUCCESS;
+}
+
+static char stub_name[BLE_GAP_DEVNAME_MAX_LEN];
+static uint16_t stub_name_len;
+
+uint32_t
+sd_ble_gap_device_name_set(const ble_gap_conn_sec_mode_t *p_write_perm, const uint8_t *p_dev_name, uint16_t len)
+{
+	if (len > sizeof(stub_name))
+		return NRF_ERROR_DATA_SIZE;
+	memcpy(stub_name, p_dev_name, len);
+	stub_name_len = len;
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ble_gap_device_name_get(uint8_t *p_dev_name, uint16_t *p_len)
+{
+	if (*p_len < stub_name_len)
+		return NRF_ERROR_DATA_SIZE;
+	memcpy(p_dev_name, stub_name, stub_name_len);
+	*p_len = stub_name_len;
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ble_gap_adv_data_set(const uint8_t *p_data, uint8_t dlen, const uint8_t *p_sr_data, uint8_t srdlen)
+{
+	STUB_LOG("sd_ble_gap_adv_data_set(len=%u)", dlen);
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ble_gap_adv_start(const ble_gap_adv_params_t *p_adv_params)
+{
+	STUB_LOG("sd_ble_gap_adv_start(interval=%u)", p_adv_params->interval);
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ble_gap_scan_start(const ble_gap_scan_params_t *p_scan_params)
+{
+	STUB_LOG("sd_ble_gap_scan_start(active=%u, interval=%u, window=%u)",
+		p_scan_params->active, p_scan_params->interval, p_scan_params->window);
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ble_gap_scan_stop(void)
+{
+	STUB_LOG("sd_ble_gap_scan_stop()");
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ble_gap_connect(const ble_gap_addr_t *p_addr, const ble_gap_scan_params_t *p_scan_params, const ble_gap_conn_params_t *p_conn_params)
+{
+	STUB_LOG("sd_ble_gap_connect(%02x:%02x:%02x:%02x:%02x:%02x)",
+		p_addr->addr[5], p_addr->addr[4], p_addr->addr[3],
+		p_addr->addr[2], p_addr->addr[1], p_addr->addr[0]);
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ble_gap_connect_cancel(void)
+{
+	STUB_LOG("sd_ble_gap_connect_cancel()");
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ble_gap_disconnect(uint16_t conn_handle, uint8_t hci_status_code)
+{
+	STUB_LOG("sd_ble_gap_disconnect(conn=%u, reason=%#x)", conn_handle, hci_status_code);
+	return NRF_SUCCESS;
+}
+
+static uint16_t stub_next_handle = 1;
+
+uint32_t
+sd_ble_gatts_service_add(uint8_t type, const ble_uuid_t *p_uuid, uint16_t *p_handle)
+{
+	*p_handle = stub_next_handle++;
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ble_gatts_characteristic_add(uint16_t service_handle, const ble_gatts_char_md_t *p_char_md, const ble_gatts_attr_t *p_attr_char_value, ble_gatts_char_handles_t *p_handles)
+{
+	stub_next_handle++;	/* declaration */
+	p_handles->value_handle = stub_next_handle++;
+	p_handles->user_desc_handle = p_char_md->p_char_user_desc ? stub_next_handle++ : 0;
+	p_handles->cccd_handle = p_char_md->p_cccd_md ? stub_next_handle++ : 0;
+	p_handles->sccd_handle = 0;
+	if (p_char_md->p_char_pf)
+		stub_next_handle++;
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ble_gatts_value_set(uint16_t conn_handle, uint16_t handle, ble_gatts_value_t *p_value)
+{
+	STUB_LOG("sd_ble_gatts_value_set(handle=%u, len=%u)", handle, p_value->len);
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ble_gatts_hvx(uint16_t conn_handle, const ble_gatts_hvx_params_t *p_hvx_params)
+{
+	STUB_LOG("sd_ble_gatts_hvx(conn=%u, handle=%u, type=%u, len=%u)", conn_handle,
+		p_hvx_params->handle, p_hvx_params->type, *p_hvx_params->p_len);
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ble_gatts_rw_authorize_reply(uint16_t conn_handle, const ble_gatts_rw_authorize_reply_params_t *p_rw_authorize_reply_params)
+{
+	STUB_LOG("sd_ble_gatts_rw_authorize_reply(conn=%u, type=%u)", conn_handle,
+		p_rw_authorize_reply_params->type);
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ble_gatts_sys_attr_set(uint16_t conn_handle, const uint8_t *p_sys_attr_data, uint16_t len, uint32_t flags)
+{
+	STUB_LOG("sd_ble_gatts_sys_attr_set(conn=%u)", conn_handle);
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ble_gattc_characteristics_discover(uint16_t conn_handle, const ble_gattc_handle_range_t *p_handle_range)
+{
+	STUB_LOG("sd_ble_gattc_characteristics_discover(conn=%u, start=%u)", conn_handle,
+		p_handle_range->start_handle);
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ble_gattc_descriptors_discover(uint16_t conn_handle, const ble_gattc_handle_range_t *p_handle_range)
+{
+	STUB_LOG("sd_ble_gattc_descriptors_discover(conn=%u, start=%u)", conn_handle,
+		p_handle_range->start_handle);
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ble_gattc_write(uint16_t conn_handle, const ble_gattc_write_params_t *p_write_params)
+{
+	STUB_LOG("sd_ble_gattc_write(conn=%u, handle=%u, len=%u)", conn_handle,
+		p_write_params->handle, p_write_params->len);
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ble_gattc_hv_confirm(uint16_t conn_handle, uint16_t handle)
+{
+	STUB_LOG("sd_ble_gattc_hv_confirm(conn=%u, handle=%u)", conn_handle, handle);
+	return NRF_SUCCESS;
+}
+
+uint32_t
+pstorage_init(void)
+{
+	return NRF_SUCCESS;
+}
+
+void
+pstorage_sys_event_handler(uint32_t sys_evt)
+{
+}
+
+ret_code_t
+dm_init(dm_init_param_t const *p_init_param)
+{
+	return NRF_SUCCESS;
+}
+
+static dm_event_cb_t dm_evt_handler;
+
+ret_code_t
+dm_register(dm_application_instance_t *p_appl_instance, dm_application_param_t const *p_appl_param)
+{
+	*p_appl_instance = 0;
+	dm_evt_handler = p_appl_param->evt_handler;
+	return NRF_SUCCESS;
+}
+
+ret_code_t
+dm_ble_evt_handler(ble_evt_t *p_ble_evt)
+{
+	/* bonding state is not reproduced, only connections are passed on
+	   so that simble_central sees its links */
+	dm_handle_t handle = {
+		.connection_id = p_ble_evt->evt.gap_evt.conn_handle,
+		.device_id = DM_INVALID_ID,
+		.service_id = DM_INVALID_ID,
+	};
+	dm_event_t event = {
+		.event_param.p_gap_param = &p_ble_evt->evt.gap_evt,
+		.event_paramlen = sizeof(ble_gap_evt_t),
+	};
+
+	switch (p_ble_evt->header.evt_id) {
+	case BLE_GAP_EVT_CONNECTED:
+		event.event_id = DM_EVT_CONNECTION;
+		break;
+	case BLE_GAP_EVT_DISCONNECTED:
+		event.event_id = DM_EVT_DISCONNECTION;
+		break;
+	default:
+		return NRF_SUCCESS;
+	}
+	if (dm_evt_handler != NULL)
+		dm_evt_handler(&handle, &event, NRF_SUCCESS);
+	return NRF_SUCCESS;
+}
+
+ret_code_t
+dm_security_setup_req(dm_handle_t *p_handle)
+{
+	STUB_LOG("dm_security_setup_req()");
+	return NRF_SUCCESS;
+}
+
+ret_code_t
+dm_peer_addr_get(dm_handle_t const *p_handle, ble_gap_addr_t *p_addr)
+{
+	/* no bonds */
+	return NRF_ERROR_NOT_FOUND;
+}
+
+int
+SEGGER_RTT_printf(unsigned BufferIndex, const char *sFormat, ...)
+{
+	return 0;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+extern int stub_verbose;
+extern uint32_t stub_now;	/* rtc_now() seen by the replayed code */
@@ -0,0 +1,180 @@
+/*
+ * Replay a binary BLE event trace (simble_trace.h) through
+ * simble_evt_dispatch, set up either by simble_init (peripheral) or
+ * simble_central_init (central), and report the host time spent per
+ * event ID.
+ *
+ * The event structures are copied verbatim: the nRF51 and x86/ARM
+ * Linux hosts share endianness, alignment and bitfield layout for the
+ * ble_evt_t members.
+ */
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <ble.h>
+#include <app_util.h>
+
+#include "simble.h"
+#include "simble_central.h"
+#include "simble_evt.h"
+#include "simble_trace.h"
+#include "sd-stub.h"
+
+struct evt_stats {
+	uint32_t count;
+	uint64_t ns;
+	uint64_t max_ns;
+};
+
+static struct evt_stats stats[256];
+static struct simble_central_ctx_t central_ctx;
+
+void replay_app_init(int central) __attribute__((weak));
+
+void
+replay_app_init(int central)
+{
+	/* replace by linking the application services with APP_SRCS */
+}
+
+static int
+read_rec(FILE *f, struct simble_trace_rec *rec, uint8_t *payload, uint32_t *skipped)
+{
+	int c;
+
+	for (;;) {
+		while ((c = fgetc(f)) != EOF && c != SIMBLE_TRACE_SYNC)
+			(*skipped)++;
+		if (c == EOF)
+			return 0;
+		rec->sync = c;
+		if (fread((uint8_t *)rec + 1, sizeof(*rec) - 1, 1, f) != 1)
+			return 0;
+		if (rec->len <= SIMBLE_TRACE_MAX_PAYLOAD && rec->len <= rec->evt_len)
+			break;
+		/* not a record header, resync after the sync byte */
+		fseek(f, 1 - (long)sizeof(*rec), SEEK_CUR);
+		(*skipped)++;
+	}
+	if (rec->len != 0 && fread(payload, rec->len, 1, f) != 1)
+		return 0;
+	return 1;
+}
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int
+parse_addr(const char *s, ble_gap_addr_t *addr)
+{
+	unsigned int b[BLE_GAP_ADDR_LEN];
+
+	if (sscanf(s, "%x:%x:%x:%x:%x:%x", &b[5], &b[4], &b[3], &b[2], &b[1], &b[0]) != 6)
+		return 0;
+	addr->addr_type = BLE_GAP_ADDR_TYPE_RANDOM_STATIC;
+	for (int i = 0; i < BLE_GAP_ADDR_LEN; i++)
+		addr->addr[i] = b[i];
+	return 1;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: trace-replay [-cv] [-p peer-addr ...] trace.bin\n");
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	uint32_t buf[CEIL_DIV(sizeof(ble_evt_t) + GATT_MTU_SIZE_DEFAULT, sizeof(uint32_t))];
+	ble_evt_t *evt = (ble_evt_t *)buf;
+	uint8_t payload[SIMBLE_TRACE_MAX_PAYLOAD];
+	struct simble_trace_rec rec;
+	uint32_t events = 0, truncated = 0, skipped = 0;
+	uint64_t total_ns = 0;
+	int central = 0;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "cvp:")) != -1) {
+		switch (ch) {
+		case 'c':
+			central = 1;
+			break;
+		case 'v':
+			stub_verbose = 1;
+			break;
+		case 'p': {
+			ble_gap_addr_t addr;
+			if (!parse_addr(optarg, &addr))
+				errx(1, "invalid peer address %s", optarg);
+			if (simble_central_peer_add(&central_ctx, &addr) < 0)
+				errx(1, "too many peers");
+			break;
+		}
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc != 1)
+		usage();
+
+	FILE *f = fopen(argv[0], "rb");
+	if (f == NULL)
+		err(1, "%s", argv[0]);
+
+	if (central) {
+		central_ctx.central = true;
+		simble_central_init("replay", &central_ctx);
+	} else {
+		simble_init("replay");
+	}
+	replay_app_init(central);
+
+	while (read_rec(f, &rec, payload, &skipped)) {
+		memset(buf, 0, sizeof(buf));
+		evt->header.evt_id = rec.evt_id;
+		evt->header.evt_len = rec.evt_len;
+		memcpy(&evt->evt, payload, rec.len);
+		if (rec.len < rec.evt_len)
+			truncated++;
+		stub_now = rec.timestamp;
+
+		uint64_t start = now_ns();
+		simble_evt_dispatch(evt);
+		uint64_t ns = now_ns() - start;
+
+		struct evt_stats *s = &stats[rec.evt_id & 0xff];
+		s->count++;
+		s->ns += ns;
+		if (ns > s->max_ns)
+			s->max_ns = ns;
+		total_ns += ns;
+		events++;
+	}
+	fclose(f);
+
+	printf("%u events, %u truncated, %u bytes skipped, %llu ns total\n",
+	       events, truncated, skipped, (unsigned long long)total_ns);
+	printf("evt_id  count      avg ns     max ns\n");
+	for (int i = 0; i < 256; i++) {
+		if (stats[i].count == 0)
+			continue;
+		printf("0x%02x %8u %10llu %10llu\n", i, stats[i].count,
+		       (unsigned long long)(stats[i].ns / stats[i].count),
+		       (unsigned long long)stats[i].max_ns);
+	}
+	return 0;
+}